@@ -0,0 +1,102 @@
+package com.example.dreamassistant
+
+import android.os.Build
+import android.os.Bundle
+import android.util.Log
+import androidx.test.ext.junit.runners.AndroidJUnit4
+import androidx.test.platform.app.InstrumentationRegistry
+import com.example.dreamassistant.ai.LlamaEngine
+import kotlinx.coroutines.runBlocking
+import org.json.JSONArray
+import org.json.JSONObject
+import org.junit.Assert.assertTrue
+import org.junit.Assume.assumeTrue
+import org.junit.Test
+import org.junit.runner.RunWith
+import java.io.File
+
+/**
+ * End-to-end benchmark through the JNI engine, run on a device farm with
+ * `./gradlew connectedAndroidTest -Pandroid.testInstrumentationRunnerArguments.class=com.example.dreamassistant.LlamaBenchmarkInstrumentedTest`.
+ *
+ * Every KV type x thread policy x prompt length x output length cell is
+ * measured through getInferenceMetrics. The JSON goes to the instrumentation
+ * status ("benchmark_json") and to files/benchmarks/ in external storage.
+ */
+@RunWith(AndroidJUnit4::class)
+class LlamaBenchmarkInstrumentedTest {
+    companion object {
+        private const val TAG = "LlamaBenchmark"
+        private val PROMPT_WORDS = listOf(16, 64, 256)
+        private val OUTPUT_TOKENS = listOf(16, 64)
+        private const val REPETITIONS = 3
+    }
+
+    @Test
+    fun benchmarkMatrix() = runBlocking {
+        // Simulated metrics are made up; there is nothing to measure until the JNI path is live
+        assumeTrue("LlamaEngine is in simulation mode", LlamaEngine.NATIVE_BACKEND)
+
+        val context = InstrumentationRegistry.getInstrumentation().targetContext
+        val modelFile = File(context.filesDir, "sister_dream_assistant.gguf")
+        val engine = LlamaEngine.getInstance()
+        val results = JSONArray()
+
+        for (kvType in LlamaEngine.KvCacheType.values()) {
+            engine.cleanup()
+            engine.configureKvCache(kvType)
+            assertTrue("model failed to load with $kvType", engine.initializeModel(context, modelFile).isSuccess)
+
+            for (policy in LlamaEngine.ThreadPolicy.values()) {
+                engine.setThreadPolicy(policy)
+
+                for (words in PROMPT_WORDS) {
+                    val prompt = List(words) { i -> if (i % 8 == 7) "ventas." else "hoy" }.joinToString(" ")
+
+                    for (outputTokens in OUTPUT_TOKENS) {
+                        val runs = JSONArray()
+                        repeat(REPETITIONS) {
+                            // A fresh conversation each time so prefill always pays for the full prompt
+                            engine.resetConversation()
+                            engine.generateParallel(listOf(0 to prompt), listOf(outputTokens))
+                            val m = engine.getInferenceMetrics()
+                            assertTrue("no prompt tokens decoded for $words words", m.prefillTokens > 0)
+                            runs.put(JSONObject()
+                                .put("ttft_ms", m.timeToFirstTokenMs)
+                                .put("prefill_tokens", m.prefillTokens)
+                                .put("prefill_tps", m.prefillTokensPerSecond)
+                                .put("decode_tokens", m.decodeTokens)
+                                .put("decode_tps", m.decodeTokensPerSecond)
+                                .put("kv_fill", m.kvFill)
+                                .put("peak_rss_kb", m.peakRssKb))
+                        }
+                        results.put(JSONObject()
+                            .put("kv_type", kvType.name)
+                            .put("thread_policy", policy.name)
+                            .put("prompt_words", words)
+                            .put("output_tokens", outputTokens)
+                            .put("runs", runs))
+                    }
+                }
+            }
+        }
+        engine.setThreadPolicy(LlamaEngine.ThreadPolicy.INTERACTIVE)
+
+        val report = JSONObject()
+            .put("device", Build.MODEL)
+            .put("soc", if (Build.VERSION.SDK_INT >= Build.VERSION_CODES.S) Build.SOC_MODEL else Build.HARDWARE)
+            .put("sdk", Build.VERSION.SDK_INT)
+            .put("model_file", modelFile.name)
+            .put("results", results)
+            .toString(2)
+
+        val outDir = File(context.getExternalFilesDir(null), "benchmarks").apply { mkdirs() }
+        File(outDir, "benchmark-${System.currentTimeMillis()}.json").writeText(report)
+        InstrumentationRegistry.getInstrumentation().sendStatus(0, Bundle().apply {
+            putString("benchmark_json", report)
+        })
+        Log.i(TAG, "📏 Benchmark written to ${outDir.absolutePath}")
+
+        assertTrue(results.length() > 0)
+    }
+}
@@ -0,0 +1,363 @@
+// Standalone on-device benchmark for the Dream Assistant GGUF.
+//
+// Runs a prompt-length x output-length matrix for every thread count and KV
+// cache type given on the command line and prints one JSON document, so runs
+// from a device farm can be compared by numbers.
+//
+//   adb push llama-android-bench model.gguf /data/local/tmp/
+//   adb shell /data/local/tmp/llama-android-bench -m /data/local/tmp/model.gguf
+//       -p 32,128,512 -n 16,64 -t 2,4 -k f16,q8_0 -r 3 -o /data/local/tmp/bench.json
+//   (one command line; wrapped here for width)
+
+#include "cpu-features.h"
+#include "llama-android.h"
+
+#include <sys/resource.h>
+#include <sys/system_properties.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "llama.h"
+
+// cpu-features.cpp logs through the JNI layer's helper; the benchmark keeps stdout for JSON
+void log_android(const std::string& tag, const std::string& message) {
+    fprintf(stderr, "[%s] %s\n", tag.c_str(), message.c_str());
+}
+
+namespace {
+
+struct BenchOptions {
+    std::string model_path;
+    std::string output_path;
+    std::vector<int> prompt_lengths;
+    std::vector<int> output_lengths;
+    std::vector<int> thread_counts;
+    std::vector<std::string> kv_types;
+    int repetitions;
+
+    BenchOptions() : repetitions(3) {}
+};
+
+// Timings of one prompt/output/threads/KV combination, one entry per repetition
+struct BenchResult {
+    std::string kv_type;
+    int n_threads;
+    int n_prompt;
+    int n_gen;
+    std::vector<double> prefill_ms;
+    std::vector<double> decode_ms;
+};
+
+typedef std::chrono::steady_clock bench_clock;
+
+double elapsed_ms(bench_clock::time_point from) {
+    return std::chrono::duration<double, std::milli>(bench_clock::now() - from).count();
+}
+
+std::vector<int> parse_int_list(const char* text) {
+    std::vector<int> values;
+    std::stringstream stream(text);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        int value = atoi(item.c_str());
+        if (value > 0) values.push_back(value);
+    }
+    return values;
+}
+
+std::vector<std::string> parse_string_list(const char* text) {
+    std::vector<std::string> values;
+    std::stringstream stream(text);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        if (!item.empty()) values.push_back(item);
+    }
+    return values;
+}
+
+bool parse_kv_type(const std::string& name, ggml_type& type) {
+    if (name == "f16")  { type = GGML_TYPE_F16;  return true; }
+    if (name == "q8_0") { type = GGML_TYPE_Q8_0; return true; }
+    if (name == "q4_0") { type = GGML_TYPE_Q4_0; return true; }
+    return false;
+}
+
+void print_usage(const char* argv0) {
+    fprintf(stderr,
+            "usage: %s -m model.gguf [-p 32,128,512] [-n 16,64] [-t 2,4] [-k f16,q8_0,q4_0] [-r 3] [-o out.json]\n",
+            argv0);
+}
+
+bool parse_args(int argc, char** argv, BenchOptions& options) {
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        if (i + 1 >= argc) {
+            fprintf(stderr, "missing value for %s\n", arg);
+            return false;
+        }
+        const char* value = argv[++i];
+
+        if (!strcmp(arg, "-m"))      options.model_path = value;
+        else if (!strcmp(arg, "-o")) options.output_path = value;
+        else if (!strcmp(arg, "-p")) options.prompt_lengths = parse_int_list(value);
+        else if (!strcmp(arg, "-n")) options.output_lengths = parse_int_list(value);
+        else if (!strcmp(arg, "-t")) options.thread_counts = parse_int_list(value);
+        else if (!strcmp(arg, "-k")) options.kv_types = parse_string_list(value);
+        else if (!strcmp(arg, "-r")) options.repetitions = std::max(1, atoi(value));
+        else {
+            fprintf(stderr, "unknown option %s\n", arg);
+            return false;
+        }
+    }
+
+    if (options.prompt_lengths.empty()) options.prompt_lengths = parse_int_list("32,128,512");
+    if (options.output_lengths.empty()) options.output_lengths = parse_int_list("16,64");
+    if (options.thread_counts.empty()) {
+        options.thread_counts.push_back((int)detect_cpu_topology().performance_cores().size());
+    }
+    if (options.kv_types.empty()) options.kv_types = parse_string_list("f16,q8_0");
+    return !options.model_path.empty();
+}
+
+// Prompt of exactly n_prompt tokens built from real Spanish text, repeated as needed
+std::vector<llama_token> make_prompt(const llama_model* model, int n_prompt) {
+    const char* text = "Hola, soy tu asistente. Hoy vamos a planear las ventas de la semana y los mensajes para tus clientes. ";
+    std::vector<llama_token> sample(256);
+    int n = llama_tokenize(model, text, (int)strlen(text), sample.data(), (int)sample.size(), false, false);
+    sample.resize(std::max(n, 1));
+
+    std::vector<llama_token> prompt;
+    prompt.push_back(llama_token_bos(model));
+    while ((int)prompt.size() < n_prompt) {
+        prompt.push_back(sample[(prompt.size() - 1) % sample.size()]);
+    }
+    prompt.resize(n_prompt);
+    return prompt;
+}
+
+int argmax_token(llama_context* ctx, int n_vocab, int index) {
+    const float* logits = llama_get_logits_ith(ctx, index);
+    return (int)(std::max_element(logits, logits + n_vocab) - logits);
+}
+
+// One repetition: prefill in n_batch chunks, then greedy decode n_gen tokens
+bool run_once(llama_context* ctx, const llama_model* model, llama_batch& batch, int batch_capacity,
+              const std::vector<llama_token>& prompt, int n_gen, double& prefill_ms, double& decode_ms) {
+    llama_kv_cache_clear(ctx);
+    int n_vocab = llama_n_vocab(model);
+    int n_prompt = (int)prompt.size();
+
+    bench_clock::time_point start = bench_clock::now();
+    for (int begin = 0; begin < n_prompt; begin += batch_capacity) {
+        int n = std::min(batch_capacity, n_prompt - begin);
+        batch.n_tokens = n;
+        for (int i = 0; i < n; i++) {
+            batch.token[i] = prompt[begin + i];
+            batch.pos[i] = begin + i;
+            batch.n_seq_id[i] = 1;
+            batch.seq_id[i][0] = 0;
+            batch.logits[i] = (begin + i == n_prompt - 1);
+        }
+        if (llama_decode(ctx, batch) != 0) return false;
+    }
+    prefill_ms = elapsed_ms(start);
+
+    llama_token token = argmax_token(ctx, n_vocab, batch.n_tokens - 1);
+    start = bench_clock::now();
+    for (int i = 0; i < n_gen; i++) {
+        batch.n_tokens = 1;
+        batch.token[0] = token;
+        batch.pos[0] = n_prompt + i;
+        batch.n_seq_id[0] = 1;
+        batch.seq_id[0][0] = 0;
+        batch.logits[0] = true;
+        if (llama_decode(ctx, batch) != 0) return false;
+        token = argmax_token(ctx, n_vocab, 0);
+    }
+    decode_ms = elapsed_ms(start);
+    return true;
+}
+
+double mean(const std::vector<double>& values) {
+    double sum = 0.0;
+    for (size_t i = 0; i < values.size(); i++) sum += values[i];
+    return values.empty() ? 0.0 : sum / values.size();
+}
+
+double stddev(const std::vector<double>& values) {
+    if (values.size() < 2) return 0.0;
+    double m = mean(values);
+    double sum = 0.0;
+    for (size_t i = 0; i < values.size(); i++) sum += (values[i] - m) * (values[i] - m);
+    return std::sqrt(sum / (values.size() - 1));
+}
+
+std::string json_escape(const std::string& text) {
+    std::string out;
+    for (size_t i = 0; i < text.size(); i++) {
+        char c = text[i];
+        if (c == '"' || c == '\\') { out += '\\'; out += c; }
+        else if ((unsigned char)c < 0x20) { char buf[8]; snprintf(buf, sizeof(buf), "\\u%04x", c); out += buf; }
+        else out += c;
+    }
+    return out;
+}
+
+std::string system_property(const char* name) {
+    char value[PROP_VALUE_MAX] = "";
+    __system_property_get(name, value);
+    return value;
+}
+
+std::string to_json(const BenchOptions& options, const llama_model* model, const std::vector<BenchResult>& results) {
+    char desc[128] = "";
+    llama_model_desc(model, desc, sizeof(desc));
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+    std::ostringstream json;
+    json << "{\n";
+    json << "  \"device\": \"" << json_escape(system_property("ro.product.model")) << "\",\n";
+    json << "  \"soc\": \"" << json_escape(system_property("ro.soc.model")) << "\",\n";
+    json << "  \"cpu_variant\": \"" << active_cpu_variant() << "\",\n";
+    json << "  \"model\": \"" << json_escape(desc) << "\",\n";
+    json << "  \"model_size_bytes\": " << llama_model_size(model) << ",\n";
+    json << "  \"model_params\": " << llama_model_n_params(model) << ",\n";
+    json << "  \"repetitions\": " << options.repetitions << ",\n";
+    json << "  \"peak_rss_kb\": " << usage.ru_maxrss << ",\n";
+    json << "  \"results\": [";
+    for (size_t r = 0; r < results.size(); r++) {
+        const BenchResult& result = results[r];
+        std::vector<double> prefill_tps, decode_tps;
+        for (size_t i = 0; i < result.prefill_ms.size(); i++) {
+            prefill_tps.push_back(result.n_prompt * 1000.0 / result.prefill_ms[i]);
+            decode_tps.push_back(result.n_gen * 1000.0 / result.decode_ms[i]);
+        }
+
+        json << (r == 0 ? "\n" : ",\n");
+        json << "    {\"kv_type\": \"" << result.kv_type << "\", \"threads\": " << result.n_threads
+             << ", \"n_prompt\": " << result.n_prompt << ", \"n_gen\": " << result.n_gen
+             << ", \"prefill_ms\": " << mean(result.prefill_ms)
+             << ", \"prefill_tps\": " << mean(prefill_tps) << ", \"prefill_tps_stddev\": " << stddev(prefill_tps)
+             << ", \"decode_ms\": " << mean(result.decode_ms)
+             << ", \"decode_tps\": " << mean(decode_tps) << ", \"decode_tps_stddev\": " << stddev(decode_tps) << "}";
+    }
+    json << "\n  ]\n}\n";
+    return json.str();
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    BenchOptions options;
+    if (!parse_args(argc, argv, options)) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    llama_backend_init();
+    load_cpu_backend();
+
+    llama_model_params model_params = llama_model_default_params();
+    model_params.n_gpu_layers = 0;
+    model_params.use_mmap = true;
+    llama_model* model = llama_load_model_from_file(options.model_path.c_str(), model_params);
+    if (model == nullptr) {
+        fprintf(stderr, "failed to load %s\n", options.model_path.c_str());
+        llama_backend_free();
+        return 1;
+    }
+
+    int n_ctx = *std::max_element(options.prompt_lengths.begin(), options.prompt_lengths.end()) +
+                *std::max_element(options.output_lengths.begin(), options.output_lengths.end());
+    std::vector<BenchResult> results;
+    bool ok = true;
+
+    for (size_t k = 0; k < options.kv_types.size() && ok; k++) {
+        ggml_type kv_type;
+        if (!parse_kv_type(options.kv_types[k], kv_type)) {
+            fprintf(stderr, "skipping unknown KV type %s\n", options.kv_types[k].c_str());
+            continue;
+        }
+
+        // Same shape as the app's contexts: one prefill chunk per ubatch
+        llama_context_params ctx_params = llama_context_default_params();
+        ctx_params.n_ctx = n_ctx;
+        ctx_params.n_batch = PREFILL_CHUNK_SIZE;
+        ctx_params.n_ubatch = PREFILL_CHUNK_SIZE;
+        ctx_params.type_k = kv_type;
+        ctx_params.type_v = kv_type;
+        ctx_params.flash_attn = kv_type != GGML_TYPE_F16;
+        llama_context* ctx = llama_new_context_with_model(model, ctx_params);
+        if (ctx == nullptr) {
+            fprintf(stderr, "failed to create a %s context\n", options.kv_types[k].c_str());
+            continue;
+        }
+
+        int batch_capacity = (int)llama_n_ubatch(ctx);
+        llama_batch batch = llama_batch_init(batch_capacity, 0, 1);
+
+        for (size_t t = 0; t < options.thread_counts.size() && ok; t++) {
+            llama_set_n_threads(ctx, options.thread_counts[t], options.thread_counts[t]);
+
+            for (size_t p = 0; p < options.prompt_lengths.size() && ok; p++) {
+                std::vector<llama_token> prompt = make_prompt(model, options.prompt_lengths[p]);
+
+                for (size_t n = 0; n < options.output_lengths.size() && ok; n++) {
+                    BenchResult result;
+                    result.kv_type = options.kv_types[k];
+                    result.n_threads = options.thread_counts[t];
+                    result.n_prompt = options.prompt_lengths[p];
+                    result.n_gen = options.output_lengths[n];
+
+                    // One untimed pass so page faults and buffer allocation don't skew the first row
+                    double prefill_ms = 0.0, decode_ms = 0.0;
+                    ok = run_once(ctx, model, batch, batch_capacity, prompt, 1, prefill_ms, decode_ms);
+
+                    for (int r = 0; r < options.repetitions && ok; r++) {
+                        ok = run_once(ctx, model, batch, batch_capacity, prompt, result.n_gen, prefill_ms, decode_ms);
+                        result.prefill_ms.push_back(prefill_ms);
+                        result.decode_ms.push_back(decode_ms);
+                    }
+                    if (ok) {
+                        fprintf(stderr, "%s t=%d pp%d tg%d done\n", result.kv_type.c_str(), result.n_threads,
+                                result.n_prompt, result.n_gen);
+                        results.push_back(result);
+                    } else {
+                        fprintf(stderr, "decode failed at %s t=%d pp%d tg%d\n", result.kv_type.c_str(),
+                                result.n_threads, result.n_prompt, result.n_gen);
+                    }
+                }
+            }
+        }
+
+        llama_batch_free(batch);
+        llama_free(ctx);
+    }
+
+    std::string json = to_json(options, model, results);
+    if (options.output_path.empty()) {
+        fputs(json.c_str(), stdout);
+    } else {
+        FILE* out = fopen(options.output_path.c_str(), "w");
+        if (out == nullptr) {
+            fprintf(stderr, "cannot write %s\n", options.output_path.c_str());
+            ok = false;
+        } else {
+            fputs(json.c_str(), out);
+            fclose(out);
+        }
+    }
+
+    llama_free_model(model);
+    llama_backend_free();
+    return ok ? 0 : 1;
+}
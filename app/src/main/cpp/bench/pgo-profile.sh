@@ -0,0 +1,45 @@
+#!/bin/sh
+# Train the PGO profile for libllama-android on a connected arm64 device:
+#
+#   ANDROID_NDK=/path/to/ndk bench/pgo-profile.sh /data/local/tmp/model.gguf
+#
+# 1. builds an instrumented llama-android-bench (LLAMA_ANDROID_PGO=GENERATE)
+# 2. runs its prefill/decode matrix on the device with the given model
+# 3. pulls the .profraw files and merges them into pgo/llama-android.profdata
+#
+# Release builds configured with -DLLAMA_ANDROID_PGO=USE then pick the profile up.
+set -e
+
+MODEL="$1"
+if [ -z "$MODEL" ] || [ -z "$ANDROID_NDK" ]; then
+    echo "usage: ANDROID_NDK=<ndk> $0 <model.gguf on device>" >&2
+    exit 1
+fi
+
+SRC_DIR="$(cd "$(dirname "$0")/.." && pwd)"
+BUILD_DIR="${BUILD_DIR:-$SRC_DIR/build-pgo}"
+DEVICE_DIR=/data/local/tmp/llama-pgo
+PROFDATA="$(ls "$ANDROID_NDK"/toolchains/llvm/prebuilt/*/bin/llvm-profdata | head -n 1)"
+
+cmake -S "$SRC_DIR" -B "$BUILD_DIR" -G Ninja \
+    -DCMAKE_TOOLCHAIN_FILE="$ANDROID_NDK/build/cmake/android.toolchain.cmake" \
+    -DANDROID_ABI=arm64-v8a \
+    -DANDROID_PLATFORM=android-24 \
+    -DCMAKE_BUILD_TYPE=Release \
+    -DLLAMA_ANDROID_PGO=GENERATE \
+    -DLLAMA_ANDROID_PGO_DIR="$DEVICE_DIR"
+cmake --build "$BUILD_DIR" --target llama-android-bench
+
+adb shell "rm -rf $DEVICE_DIR && mkdir -p $DEVICE_DIR"
+adb push "$BUILD_DIR/llama-android-bench" "$DEVICE_DIR/"
+# Same prompt/output lengths and KV types as the instrumented benchmark test
+adb shell "cd $DEVICE_DIR && ./llama-android-bench -m '$MODEL' -p 16,64,256 -n 16,64 -k f16,q8_0,q4_0 -r 1 -o bench.json"
+
+rm -rf "$BUILD_DIR/profraw"
+mkdir -p "$BUILD_DIR/profraw" "$SRC_DIR/pgo"
+adb shell "ls $DEVICE_DIR/*.profraw" | tr -d '\r' | while read -r f; do
+    adb pull "$f" "$BUILD_DIR/profraw/"
+done
+"$PROFDATA" merge -o "$SRC_DIR/pgo/llama-android.profdata" "$BUILD_DIR"/profraw/*.profraw
+
+echo "📈 Profile written to $SRC_DIR/pgo/llama-android.profdata"
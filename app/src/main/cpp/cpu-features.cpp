@@ -0,0 +1,158 @@
+#include "cpu-features.h"
+#include "llama-android.h"
+
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <unistd.h>
+
+#if defined(__aarch64__)
+#include <sys/auxv.h>
+#endif
+
+#include "ggml-backend.h"
+
+// Bits from <asm/hwcap.h>, repeated here for older NDK headers
+#ifndef HWCAP_FPHP
+#define HWCAP_FPHP (1 << 9)
+#endif
+#ifndef HWCAP_ASIMDHP
+#define HWCAP_ASIMDHP (1 << 10)
+#endif
+#ifndef HWCAP_ASIMDDP
+#define HWCAP_ASIMDDP (1 << 20)
+#endif
+#ifndef HWCAP_SVE
+#define HWCAP_SVE (1 << 22)
+#endif
+#ifndef HWCAP2_I8MM
+#define HWCAP2_I8MM (1 << 13)
+#endif
+
+static std::mutex g_cpu_backend_mutex;
+static bool g_cpu_backend_loaded = false;
+static std::string g_cpu_variant = "builtin";
+
+CpuFeatures detect_cpu_features() {
+    CpuFeatures features;
+#if defined(__aarch64__)
+    unsigned long hwcap = getauxval(AT_HWCAP);
+    unsigned long hwcap2 = getauxval(AT_HWCAP2);
+
+    features.neon = true; // mandatory on arm64-v8a
+    features.fp16 = (hwcap & HWCAP_FPHP) && (hwcap & HWCAP_ASIMDHP);
+    features.dotprod = (hwcap & HWCAP_ASIMDDP) != 0;
+    features.i8mm = (hwcap2 & HWCAP2_I8MM) != 0;
+    features.sve = (hwcap & HWCAP_SVE) != 0;
+#endif
+    return features;
+}
+
+CpuVariant best_cpu_variant(const CpuFeatures& features) {
+    if (features.dotprod && features.fp16 && features.i8mm && features.sve) return CPU_VARIANT_SVE;
+    if (features.dotprod && features.fp16 && features.i8mm) return CPU_VARIANT_I8MM;
+    if (features.dotprod && features.fp16) return CPU_VARIANT_DOTPROD;
+    return CPU_VARIANT_ARMV8;
+}
+
+const char* cpu_variant_name(CpuVariant variant) {
+    switch (variant) {
+        case CPU_VARIANT_SVE: return "sve";
+        case CPU_VARIANT_I8MM: return "i8mm";
+        case CPU_VARIANT_DOTPROD: return "dotprod";
+        default: return "armv8";
+    }
+}
+
+const char* cpu_variant_library(CpuVariant variant) {
+    switch (variant) {
+        case CPU_VARIANT_SVE: return "libggml-cpu-sve.so";
+        case CPU_VARIANT_I8MM: return "libggml-cpu-i8mm.so";
+        case CPU_VARIANT_DOTPROD: return "libggml-cpu-dotprod.so";
+        default: return "libggml-cpu-armv8.so";
+    }
+}
+
+bool load_cpu_backend() {
+#if defined(LLAMA_ANDROID_CPU_VARIANTS)
+    std::lock_guard<std::mutex> lock(g_cpu_backend_mutex);
+    if (g_cpu_backend_loaded) return true;
+
+    CpuFeatures features = detect_cpu_features();
+    log_android(LOG_TAG, std::string("🧬 CPU features: fp16=") + (features.fp16 ? "1" : "0") +
+                         " dotprod=" + (features.dotprod ? "1" : "0") +
+                         " i8mm=" + (features.i8mm ? "1" : "0") +
+                         " sve=" + (features.sve ? "1" : "0"));
+
+    // The APK's native lib dir is on the linker search path, so bare sonames resolve
+    for (int v = best_cpu_variant(features); v >= CPU_VARIANT_ARMV8; v--) {
+        CpuVariant variant = (CpuVariant)v;
+        if (ggml_backend_load(cpu_variant_library(variant)) != nullptr) {
+            g_cpu_variant = cpu_variant_name(variant);
+            g_cpu_backend_loaded = true;
+            log_android(LOG_TAG, "⚙️ Using ggml CPU backend: " + g_cpu_variant);
+            return true;
+        }
+        log_android(LOG_TAG, std::string("⚠️ Could not load ") + cpu_variant_library(variant));
+    }
+
+    log_android(LOG_TAG, "❌ No ggml CPU backend could be loaded");
+    return false;
+#else
+    // CPU backend is compiled into libllama-android.so
+    return true;
+#endif
+}
+
+std::string active_cpu_variant() {
+    std::lock_guard<std::mutex> lock(g_cpu_backend_mutex);
+    return g_cpu_variant;
+}
+
+std::vector<int> CpuTopology::performance_cores() const {
+    std::vector<int> cores(prime);
+    cores.insert(cores.end(), mid.begin(), mid.end());
+    return cores;
+}
+
+std::vector<int> CpuTopology::all_cores() const {
+    std::vector<int> cores = performance_cores();
+    cores.insert(cores.end(), little.begin(), little.end());
+    return cores;
+}
+
+static long read_max_freq(int cpu) {
+    std::ifstream file("/sys/devices/system/cpu/cpu" + std::to_string(cpu) + "/cpufreq/cpuinfo_max_freq");
+    long khz = 0;
+    if (!(file >> khz)) return 0;
+    return khz;
+}
+
+CpuTopology detect_cpu_topology() {
+    CpuTopology topology;
+    long n_cpus = sysconf(_SC_NPROCESSORS_CONF);
+    if (n_cpus <= 0) n_cpus = 1;
+
+    std::map<long, std::vector<int> > clusters;
+    for (int cpu = 0; cpu < n_cpus; cpu++) {
+        clusters[read_max_freq(cpu)].push_back(cpu);
+    }
+
+    // Unknown frequencies or a single cluster: every core counts as a performance core
+    if (clusters.size() == 1 || clusters.count(0)) {
+        for (int cpu = 0; cpu < n_cpus; cpu++) topology.mid.push_back(cpu);
+        return topology;
+    }
+
+    // Lowest frequency cluster is little, highest is prime, anything between is mid
+    std::map<long, std::vector<int> >::iterator it = clusters.begin();
+    topology.little = it->second;
+    for (++it; it != clusters.end(); ++it) {
+        std::map<long, std::vector<int> >::iterator next = it;
+        ++next;
+        std::vector<int>& target = next == clusters.end() ? topology.prime : topology.mid;
+        target.insert(target.end(), it->second.begin(), it->second.end());
+    }
+    return topology;
+}
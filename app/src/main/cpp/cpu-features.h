@@ -0,0 +1,59 @@
+#ifndef CPU_FEATURES_H
+#define CPU_FEATURES_H
+
+#include <string>
+#include <vector>
+
+// ggml CPU backend builds shipped in the APK, from safest to fastest
+enum CpuVariant {
+    CPU_VARIANT_ARMV8 = 0,   // baseline NEON, runs on every arm64-v8a device
+    CPU_VARIANT_DOTPROD,     // ARMv8.2 sdot/udot + fp16
+    CPU_VARIANT_I8MM,        // ARMv8.6 int8 matrix multiply (smmla)
+    CPU_VARIANT_SVE,         // SVE on top of i8mm
+    CPU_VARIANT_COUNT
+};
+
+struct CpuFeatures {
+    bool neon;
+    bool fp16;
+    bool dotprod;
+    bool i8mm;
+    bool sve;
+
+    CpuFeatures() : neon(false), fp16(false), dotprod(false), i8mm(false), sve(false) {}
+};
+
+// Read the kernel-reported ISA extensions via getauxval(AT_HWCAP/AT_HWCAP2)
+CpuFeatures detect_cpu_features();
+
+// Best variant the current CPU can execute
+CpuVariant best_cpu_variant(const CpuFeatures& features);
+
+// Shared library name of a variant, e.g. "libggml-cpu-dotprod.so"
+const char* cpu_variant_library(CpuVariant variant);
+const char* cpu_variant_name(CpuVariant variant);
+
+// Load and register the best ggml CPU backend, falling back to older variants
+// if a library is missing. Safe to call repeatedly; only the first call loads.
+bool load_cpu_backend();
+
+// Name of the variant in use, or "builtin" if the CPU backend is linked statically
+std::string active_cpu_variant();
+
+// Cores grouped by cpufreq max frequency, e.g. 1+3+4 -> prime {7}, mid {4,5,6}, little {0-3}
+struct CpuTopology {
+    std::vector<int> little;
+    std::vector<int> mid;
+    std::vector<int> prime;
+
+    int n_cores() const { return (int)(little.size() + mid.size() + prime.size()); }
+    // mid + prime: the cores worth pinning latency-sensitive decode to
+    std::vector<int> performance_cores() const;
+    std::vector<int> all_cores() const;
+};
+
+// Read /sys/devices/system/cpu/cpu*/cpufreq/cpuinfo_max_freq; cores whose
+// frequency cannot be read are treated as a single homogeneous cluster
+CpuTopology detect_cpu_topology();
+
+#endif // CPU_FEATURES_H
@@ -0,0 +1,144 @@
+#include "inference-queue.h"
+
+#include <algorithm>
+
+// The queue whose worker is the current thread; preemption only applies to its jobs
+static thread_local const InferenceQueue* t_worker_queue = nullptr;
+
+InferenceQueue::InferenceQueue()
+        : next_id_(1), next_order_(0), running_(false), stopping_(false),
+          running_priority_(PRIORITY_COUNT), best_waiting_(PRIORITY_COUNT), running_id_(0) {}
+
+InferenceQueue::~InferenceQueue() {
+    stop();
+}
+
+void InferenceQueue::start(const ThreadHook& on_start, const ThreadHook& on_exit) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (running_ || stopping_) return;
+    running_ = true;
+    worker_ = std::thread(&InferenceQueue::run, this, on_start, on_exit);
+}
+
+bool InferenceQueue::started() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return running_;
+}
+
+void InferenceQueue::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (stopping_) return;
+        stopping_ = true;
+        cancelled_.insert(cancelled_.end(), heap_.begin(), heap_.end());
+        heap_.clear();
+        update_best_waiting_locked();
+    }
+    wake_.notify_all();
+    if (worker_.joinable()) {
+        worker_.join();
+    }
+}
+
+uint64_t InferenceQueue::submit(int priority, const Job& job, bool preemptible) {
+    uint64_t id;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!running_ || stopping_) return 0;
+
+        Entry entry;
+        entry.id = id = next_id_++;
+        entry.order = next_order_++;
+        entry.priority = std::max(0, std::min(priority, PRIORITY_COUNT - 1));
+        entry.preemptible = preemptible;
+        entry.job = job;
+        push_locked(entry);
+    }
+    wake_.notify_one();
+    return id;
+}
+
+bool InferenceQueue::cancel(uint64_t id) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::vector<Entry>::iterator it = heap_.begin();
+        while (it != heap_.end() && it->id != id) ++it;
+        if (it == heap_.end()) return false;
+
+        cancelled_.push_back(*it);
+        heap_.erase(it);
+        std::make_heap(heap_.begin(), heap_.end(), RunsLater());
+        update_best_waiting_locked();
+    }
+    wake_.notify_one();
+    return true;
+}
+
+bool InferenceQueue::preempt_requested() const {
+    return t_worker_queue == this && best_waiting_.load() < running_priority_.load();
+}
+
+size_t InferenceQueue::pending() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return heap_.size();
+}
+
+void InferenceQueue::push_locked(const Entry& entry) {
+    heap_.push_back(entry);
+    std::push_heap(heap_.begin(), heap_.end(), RunsLater());
+    update_best_waiting_locked();
+}
+
+void InferenceQueue::update_best_waiting_locked() {
+    best_waiting_.store(heap_.empty() ? (int)PRIORITY_COUNT : heap_.front().priority);
+}
+
+void InferenceQueue::run(ThreadHook on_start, ThreadHook on_exit) {
+    t_worker_queue = this;
+    if (on_start) on_start();
+
+    while (true) {
+        Entry entry;
+        bool cancelled;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            wake_.wait(lock, [this] { return stopping_ || !heap_.empty() || !cancelled_.empty(); });
+
+            if (!cancelled_.empty()) {
+                entry = cancelled_.back();
+                cancelled_.pop_back();
+                cancelled = true;
+            } else if (!heap_.empty()) {
+                std::pop_heap(heap_.begin(), heap_.end(), RunsLater());
+                entry = heap_.back();
+                heap_.pop_back();
+                update_best_waiting_locked();
+                running_priority_.store(entry.preemptible ? entry.priority : (int)PRIORITY_COUNT);
+                running_id_.store(entry.id);
+                cancelled = false;
+            } else {
+                break; // stopping and drained
+            }
+        }
+
+        bool done = entry.job(cancelled);
+        if (cancelled) continue;
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            running_priority_.store(PRIORITY_COUNT);
+            running_id_.store(0);
+            if (!done) {
+                // Yielded: same order key, so it resumes before later work of its priority
+                if (stopping_) {
+                    cancelled_.push_back(entry);
+                } else {
+                    push_locked(entry);
+                }
+            }
+        }
+    }
+
+    if (on_exit) on_exit();
+    t_worker_queue = nullptr;
+}
@@ -0,0 +1,87 @@
+#ifndef INFERENCE_QUEUE_H
+#define INFERENCE_QUEUE_H
+
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Lower value runs first (values match RequestPriority in LlamaEngine.kt)
+enum RequestPriority {
+    PRIORITY_INTERACTIVE = 0, // a reply the user is waiting for
+    PRIORITY_NORMAL = 1,
+    PRIORITY_BACKGROUND = 2,  // warm-up, intent exemplars, batch work
+    PRIORITY_COUNT
+};
+
+// One worker thread that owns a llama_context. Requests run one at a time in priority
+// order, FIFO within a priority. A preemptible job (warm-up, embeddings) can yield by
+// returning false after its decode was aborted because preempt_requested() turned true;
+// it is queued again ahead of later work of its own priority. Chat turns are submitted
+// non-preemptible since a half-decoded turn cannot simply be replayed. Jobs that never
+// get to run are invoked on the worker with cancelled = true, so completion callbacks
+// always fire on the same thread.
+class InferenceQueue {
+public:
+    typedef std::function<bool(bool cancelled)> Job;
+    typedef std::function<void()> ThreadHook;
+
+    InferenceQueue();
+    ~InferenceQueue();
+
+    // Start the worker once; later calls are no-ops. Hooks run on the worker (JNI attach/detach).
+    void start(const ThreadHook& on_start, const ThreadHook& on_exit);
+    // Cancel everything still queued, let the running job finish and join the worker
+    void stop();
+    bool started() const;
+
+    // Request id, or 0 when the queue is not running (the job is then not kept)
+    uint64_t submit(int priority, const Job& job, bool preemptible);
+    // Drop a queued request; false if it is already running or done
+    bool cancel(uint64_t id);
+
+    // On the worker thread: the running job is preemptible and a more urgent request is
+    // waiting. Cheap enough for abort callbacks.
+    bool preempt_requested() const;
+    uint64_t running_id() const { return running_id_.load(); }
+    size_t pending() const;
+
+private:
+    struct Entry {
+        uint64_t id;
+        uint64_t order;
+        int priority;
+        bool preemptible;
+        Job job;
+    };
+    struct RunsLater {
+        bool operator()(const Entry& a, const Entry& b) const {
+            return a.priority != b.priority ? a.priority > b.priority : a.order > b.order;
+        }
+    };
+
+    void run(ThreadHook on_start, ThreadHook on_exit);
+    void push_locked(const Entry& entry);
+    void update_best_waiting_locked();
+
+    mutable std::mutex mutex_;
+    std::condition_variable wake_;
+    std::vector<Entry> heap_;      // std::push_heap/pop_heap with RunsLater
+    std::vector<Entry> cancelled_; // waiting for the worker to deliver cancelled = true
+    std::thread worker_;
+    uint64_t next_id_;
+    uint64_t next_order_;
+    bool running_;
+    bool stopping_;
+    std::atomic<int> running_priority_; // PRIORITY_COUNT unless a preemptible job runs
+    std::atomic<int> best_waiting_;
+    std::atomic<uint64_t> running_id_;
+
+    InferenceQueue(const InferenceQueue&);
+    InferenceQueue& operator=(const InferenceQueue&);
+};
+
+#endif // INFERENCE_QUEUE_H
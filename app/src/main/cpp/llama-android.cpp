@@ -1,219 +1,3673 @@
 #include "llama-android.h"
+#include "cpu-features.h"
+#include "trace.h"
 #include <android/log.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#if defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+#include <cmath>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
 #include <chrono>
+#include <cstring>
+#include <ctime>
+#include <algorithm>
+#include <functional>
 #include <vector>
 #include <sstream>
 #include <iostream>
 
 // Include llama.cpp headers
 #include "llama.h"
+#include "ggml-cpu.h"
 #include "common.h"
 
 // Utility functions implementation
+
+// JNI's *StringUTF* calls speak "modified UTF-8", which encodes emoji as surrogate
+// pairs (and CheckJNI aborts on real 4-byte sequences), so convert via UTF-16 instead
 std::string jstring_to_string(JNIEnv* env, jstring jstr) {
+    TRACE_SECTION("jni:jstring_to_string");
     if (jstr == nullptr) return "";
 
-    const char* chars = env->GetStringUTFChars(jstr, nullptr);
-    std::string result(chars);
-    env->ReleaseStringUTFChars(jstr, chars);
-    return result;
+    jsize len = env->GetStringLength(jstr);
+    std::vector<jchar> utf16(len);
+    env->GetStringRegion(jstr, 0, len, utf16.data());
+
+    std::string result;
+    result.reserve(len);
+    for (jsize i = 0; i < len; i++) {
+        uint32_t cp = utf16[i];
+        if (cp >= 0xD800 && cp <= 0xDBFF && i + 1 < len && utf16[i + 1] >= 0xDC00 && utf16[i + 1] <= 0xDFFF) {
+            cp = 0x10000 + ((cp - 0xD800) << 10) + (utf16[++i] - 0xDC00);
+        } else if (cp >= 0xD800 && cp <= 0xDFFF) {
+            cp = 0xFFFD; // lone surrogate
+        }
+
+        if (cp < 0x80) {
+            result += (char)cp;
+        } else if (cp < 0x800) {
+            result += (char)(0xC0 | (cp >> 6));
+            result += (char)(0x80 | (cp & 0x3F));
+        } else if (cp < 0x10000) {
+            result += (char)(0xE0 | (cp >> 12));
+            result += (char)(0x80 | ((cp >> 6) & 0x3F));
+            result += (char)(0x80 | (cp & 0x3F));
+        } else {
+            result += (char)(0xF0 | (cp >> 18));
+            result += (char)(0x80 | ((cp >> 12) & 0x3F));
+            result += (char)(0x80 | ((cp >> 6) & 0x3F));
+            result += (char)(0x80 | (cp & 0x3F));
+        }
+    }
+    return result;
+}
+
+jstring string_to_jstring(JNIEnv* env, const std::string& str) {
+    TRACE_SECTION("jni:string_to_jstring");
+    std::vector<jchar> utf16;
+    utf16.reserve(str.size());
+
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(str.data());
+    const unsigned char* end = p + str.size();
+    while (p < end) {
+        uint32_t cp;
+        size_t n;
+        if (*p < 0x80) { cp = *p; n = 1; }
+        else if ((*p & 0xE0) == 0xC0) { cp = *p & 0x1F; n = 2; }
+        else if ((*p & 0xF0) == 0xE0) { cp = *p & 0x0F; n = 3; }
+        else if ((*p & 0xF8) == 0xF0) { cp = *p & 0x07; n = 4; }
+        else { cp = 0xFFFD; n = 1; }
+
+        if (n > 1) {
+            if ((size_t)(end - p) < n) {
+                cp = 0xFFFD;
+                n = end - p;
+            } else {
+                for (size_t k = 1; k < n; k++) {
+                    if ((p[k] & 0xC0) != 0x80) { cp = 0xFFFD; n = k; break; }
+                    cp = (cp << 6) | (p[k] & 0x3F);
+                }
+            }
+        }
+        p += n;
+
+        if (cp >= 0x10000) {
+            cp -= 0x10000;
+            utf16.push_back((jchar)(0xD800 + (cp >> 10)));
+            utf16.push_back((jchar)(0xDC00 + (cp & 0x3FF)));
+        } else {
+            utf16.push_back((jchar)cp);
+        }
+    }
+    return env->NewString(utf16.data(), (jsize)utf16.size());
+}
+
+void log_android(const std::string& tag, const std::string& message) {
+    __android_log_print(ANDROID_LOG_INFO, tag.c_str(), "%s", message.c_str());
+}
+
+// Sister-specific prompting for Dream Assistant
+static const char* SISTER_SYSTEM_PREFIX =
+        "Eres el Dream Assistant, la compañera perfecta para mi hermana emprendedora. "
+        "Ella tiene dificultades del habla pero sueña con crear su plataforma digital. "
+        "Responde de manera cariñosa, motivacional y práctica. "
+        "Entiende que ella necesita apoyo emocional y técnico para lograr sus metas.\n\n";
+
+// Tokenize into a reused per-thread scratch buffer; a negative return from llama_tokenize
+// gives the exact size needed, and the result vector is allocated at exactly n tokens.
+// User text is tokenized with parse_special off so a transcript cannot inject turn markup.
+static std::vector<llama_token> tokenize_text(LlamaModelWrapper* wrapper, const std::string& text, bool add_special,
+                                              bool parse_special = true) {
+    TRACE_SECTION("llama:tokenize");
+    static thread_local std::vector<llama_token> scratch(256);
+
+    int n_tokens = llama_tokenize((llama_model*)wrapper->model, text.c_str(), text.length(),
+                                  scratch.data(), scratch.size(), add_special, parse_special);
+    if (n_tokens < 0) {
+        scratch.resize(-n_tokens);
+        n_tokens = llama_tokenize((llama_model*)wrapper->model, text.c_str(), text.length(),
+                                  scratch.data(), scratch.size(), add_special, parse_special);
+    }
+    if (n_tokens <= 0) {
+        return std::vector<llama_token>();
+    }
+    return std::vector<llama_token>(scratch.begin(), scratch.begin() + n_tokens);
+}
+
+size_t TokenCache::make_key(const std::string& text, bool add_special) {
+    return std::hash<std::string>()(text) ^ (add_special ? 0x9e3779b97f4a7c15ULL : 0);
+}
+
+bool TokenCache::get(const std::string& text, bool add_special, std::vector<llama_token>& out) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::unordered_map<size_t, std::list<Entry>::iterator>::iterator it = index_.find(make_key(text, add_special));
+    if (it == index_.end() || it->second->add_special != add_special || it->second->text != text) {
+        return false;
+    }
+    entries_.splice(entries_.begin(), entries_, it->second);
+    out = it->second->tokens;
+    return true;
+}
+
+void TokenCache::put(const std::string& text, bool add_special, const std::vector<llama_token>& tokens) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    size_t key = make_key(text, add_special);
+
+    std::unordered_map<size_t, std::list<Entry>::iterator>::iterator it = index_.find(key);
+    if (it != index_.end()) {
+        entries_.erase(it->second);
+        index_.erase(it);
+    }
+
+    Entry entry;
+    entry.key = key;
+    entry.text = text;
+    entry.add_special = add_special;
+    entry.tokens = tokens;
+    entries_.push_front(entry);
+    index_[key] = entries_.begin();
+
+    while (entries_.size() > capacity_) {
+        index_.erase(entries_.back().key);
+        entries_.pop_back();
+    }
+}
+
+void TokenCache::clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    entries_.clear();
+    index_.clear();
+}
+
+static std::vector<llama_token> tokenize_cached(LlamaModelWrapper* wrapper, const std::string& text, bool add_special) {
+    std::vector<llama_token> tokens;
+    if (wrapper->token_cache.get(text, add_special, tokens)) {
+        return tokens;
+    }
+    tokens = tokenize_text(wrapper, text, add_special);
+    wrapper->token_cache.put(text, add_special, tokens);
+    return tokens;
+}
+
+// Id of a control token such as "<end_of_turn>", or -1 if the vocab splits it into pieces
+static llama_token single_special_token(LlamaModelWrapper* wrapper, const char* text) {
+    std::vector<llama_token> tokens = tokenize_text(wrapper, text, false);
+    return tokens.size() == 1 ? tokens[0] : (llama_token)-1;
+}
+
+// Gemma has no system role, so the preamble opens the first user turn. Models without the
+// turn tokens keep the plain "Usuario:/Dream Assistant:" layout, pre-tokenized the same way.
+static void build_chat_template(LlamaModelWrapper* wrapper) {
+    ChatTemplate& tpl = wrapper->chat_template;
+    tpl = ChatTemplate();
+
+    llama_token start_of_turn = single_special_token(wrapper, "<start_of_turn>");
+    llama_token end_of_turn = single_special_token(wrapper, "<end_of_turn>");
+    if (start_of_turn >= 0 && end_of_turn >= 0) {
+        tpl.gemma = true;
+        tpl.end_of_turn = end_of_turn;
+        tpl.system_prefix = tokenize_text(wrapper, std::string("<start_of_turn>user\n") + SISTER_SYSTEM_PREFIX, true);
+        tpl.user_open = tokenize_text(wrapper, "<end_of_turn>\n<start_of_turn>user\n", false);
+        tpl.model_open = tokenize_text(wrapper, "<end_of_turn>\n<start_of_turn>model\n", false);
+    } else {
+        tpl.system_prefix = tokenize_text(wrapper, SISTER_SYSTEM_PREFIX, true);
+        tpl.first_user_open = tokenize_text(wrapper, "Usuario: ", false);
+        tpl.user_open = tokenize_text(wrapper, "\nUsuario: ", false);
+        tpl.model_open = tokenize_text(wrapper, "\nDream Assistant: ", false);
+    }
+
+    log_android(LOG_TAG, std::string("📝 Chat template: ") + (tpl.gemma ? "gemma" : "plain") +
+                         ", end_of_turn " + std::to_string(tpl.end_of_turn) +
+                         ", prefix " + std::to_string(tpl.system_prefix.size()) + " tokens");
+}
+
+// Recreates whatever trimMemory released; every request calls it right after taking ctx_mutex
+static bool ensure_context(LlamaModelWrapper* wrapper);
+
+// Stop on <end_of_turn> even when the GGUF does not flag it as end-of-generation
+static bool is_end_of_turn(const LlamaModelWrapper* wrapper, llama_token token) {
+    return token == wrapper->chat_template.end_of_turn || llama_token_is_eog((llama_model*)wrapper->model, token);
+}
+
+// Drop everything after the system prefix and start a fresh conversation
+static void session_reset(LlamaModelWrapper* wrapper, LlamaSession& session) {
+    llama_kv_cache_seq_rm((llama_context*)wrapper->ctx, session.seq_id, wrapper->n_prefix, -1);
+    session.tokens.resize(wrapper->n_prefix);
+    session.turn_starts.clear();
+    session.n_turns = 0;
+}
+
+static void session_reset(LlamaModelWrapper* wrapper) {
+    session_reset(wrapper, wrapper->session);
+    wrapper->partial_start = -1;
+}
+
+// Result of feeding tokens into the KV cache
+enum DecodeStatus {
+    DECODE_OK = 0,
+    DECODE_FAILED,
+    DECODE_CANCELLED
+};
+
+// cancelGeneration/cancelRequest since the running request arrived at ctx_mutex
+static bool cancel_pending(const LlamaModelWrapper* wrapper) {
+    return wrapper->cancel_epoch.load() != wrapper->request_epoch.load();
+}
+
+// ctx_mutex held for one request. The epoch is read before waiting, so a cancel sent while
+// the request is still queued on the mutex counts, and stamped once the lock is held, so
+// cancels aimed at an earlier request (or at nothing) do not
+struct RequestLock {
+    uint32_t epoch;
+    std::lock_guard<std::mutex> lock;
+
+    explicit RequestLock(LlamaModelWrapper* wrapper)
+        : epoch(wrapper->cancel_epoch.load()), lock(wrapper->ctx_mutex) {
+        wrapper->request_epoch.store(epoch);
+    }
+};
+
+// Prefill progress (tokens done / total); return false to cancel between chunks
+typedef std::function<bool(int n_done, int n_total)> ProgressCallback;
+
+// Decode tokens at the end of the session in prefill_chunk sized llama_batch pieces and
+// record them as cached. Logits are only requested for the very last token. On cancel the
+// chunks already decoded stay in the session; the caller decides whether to keep them.
+static DecodeStatus session_decode(LlamaModelWrapper* wrapper, LlamaSession& session,
+                                   const llama_token* tokens, int n_tokens,
+                                   const ProgressCallback& on_progress = ProgressCallback()) {
+    TRACE_SECTION("llama:decode");
+    llama_batch& batch = wrapper->batch;
+    int chunk = std::max(1, std::min(wrapper->prefill_chunk.load(), wrapper->batch_capacity));
+
+    for (int start = 0; start < n_tokens; start += chunk) {
+        int n = std::min(chunk, n_tokens - start);
+        llama_pos pos = (llama_pos)session.tokens.size();
+
+        batch.n_tokens = n;
+        for (int i = 0; i < n; i++) {
+            batch.token[i] = tokens[start + i];
+            batch.pos[i] = pos + i;
+            batch.n_seq_id[i] = 1;
+            batch.seq_id[i][0] = session.seq_id;
+            batch.logits[i] = (start + i == n_tokens - 1);
+        }
+
+        int ret = llama_decode((llama_context*)wrapper->ctx, batch);
+        if (ret != 0) {
+            // Drop any cells the failed/aborted chunk left behind so the cache matches session.tokens
+            llama_kv_cache_seq_rm((llama_context*)wrapper->ctx, session.seq_id, pos, -1);
+            return ret == 2 || cancel_pending(wrapper) ? DECODE_CANCELLED : DECODE_FAILED;
+        }
+        session.tokens.insert(session.tokens.end(), tokens + start, tokens + start + n);
+        wrapper->n_evaluated += n;
+
+        if (start + n < n_tokens && (cancel_pending(wrapper) || wrapper->shutting_down.load())) {
+            return DECODE_CANCELLED;
+        }
+
+        if (n_tokens > 1 && on_progress && !on_progress(start + n, n_tokens)) {
+            return start + n < n_tokens ? DECODE_CANCELLED : DECODE_OK;
+        }
+    }
+    return DECODE_OK;
+}
+
+static DecodeStatus session_decode(LlamaModelWrapper* wrapper, const llama_token* tokens, int n_tokens,
+                                   const ProgressCallback& on_progress = ProgressCallback()) {
+    return session_decode(wrapper, wrapper->session, tokens, n_tokens, on_progress);
+}
+
+// Decode one token for each session in a single llama_decode; batch index i holds
+// sessions[i], so its logits are read back with llama_get_logits_ith(ctx, i)
+static DecodeStatus decode_parallel_step(LlamaModelWrapper* wrapper, const std::vector<LlamaSession*>& sessions,
+                                         const std::vector<llama_token>& tokens) {
+    TRACE_SECTION("llama:decode_parallel");
+    llama_batch& batch = wrapper->batch;
+    int n = (int)sessions.size();
+
+    batch.n_tokens = n;
+    for (int i = 0; i < n; i++) {
+        batch.token[i] = tokens[i];
+        batch.pos[i] = (llama_pos)sessions[i]->tokens.size();
+        batch.n_seq_id[i] = 1;
+        batch.seq_id[i][0] = sessions[i]->seq_id;
+        batch.logits[i] = true;
+    }
+
+    int ret = llama_decode((llama_context*)wrapper->ctx, batch);
+    if (ret != 0) {
+        for (int i = 0; i < n; i++) {
+            llama_kv_cache_seq_rm((llama_context*)wrapper->ctx, sessions[i]->seq_id,
+                                  (llama_pos)sessions[i]->tokens.size(), -1);
+        }
+        return ret == 2 || cancel_pending(wrapper) ? DECODE_CANCELLED : DECODE_FAILED;
+    }
+
+    for (int i = 0; i < n; i++) {
+        sessions[i]->tokens.push_back(tokens[i]);
+    }
+    wrapper->n_evaluated += n;
+    return DECODE_OK;
+}
+
+// Truncate the session to its longest common prefix with `target` and return that length.
+// At least the last target token is left undecoded so fresh logits come with it.
+static size_t session_rewind(LlamaModelWrapper* wrapper, LlamaSession& session,
+                             const std::vector<llama_token>& target) {
+    size_t n_keep = 0;
+    while (n_keep < session.tokens.size() && n_keep < target.size() &&
+           session.tokens[n_keep] == target[n_keep]) {
+        n_keep++;
+    }
+
+    // Re-decode at least the last token so fresh logits are available for sampling
+    if (n_keep == target.size() && n_keep > 0) {
+        n_keep--;
+    }
+
+    if (n_keep < session.tokens.size()) {
+        llama_kv_cache_seq_rm((llama_context*)wrapper->ctx, session.seq_id, (llama_pos)n_keep, -1);
+        session.tokens.resize(n_keep);
+        while (!session.turn_starts.empty() && session.turn_starts.back() >= n_keep) {
+            session.turn_starts.pop_back();
+        }
+    }
+    return n_keep;
+}
+
+// Evict the oldest turn right after the pinned prefix: its cells are removed and every
+// later cell slides down by the same amount, so nothing already cached is decoded again
+static void session_evict_oldest_turn(LlamaModelWrapper* wrapper, LlamaSession& session) {
+    size_t begin = std::max((size_t)wrapper->n_prefix, session.turn_starts.front());
+    size_t end = session.turn_starts.size() > 1 ? session.turn_starts[1] : session.tokens.size();
+    llama_pos n_discard = (llama_pos)(end - begin);
+
+    llama_kv_cache_seq_rm((llama_context*)wrapper->ctx, session.seq_id, (llama_pos)begin, (llama_pos)end);
+    llama_kv_cache_seq_add((llama_context*)wrapper->ctx, session.seq_id, (llama_pos)end, -1, -n_discard);
+
+    session.tokens.erase(session.tokens.begin() + begin, session.tokens.begin() + end);
+    session.turn_starts.erase(session.turn_starts.begin());
+    for (size_t i = 0; i < session.turn_starts.size(); i++) {
+        session.turn_starts[i] -= n_discard;
+    }
+}
+
+// Make room for `turn` plus `n_reply` generated tokens within `capacity` tokens for the
+// whole session (-1: the context size). Old turns are shifted out first; a turn that alone
+// overflows keeps only its tail (the end carries the reply cue).
+static void session_make_room(LlamaModelWrapper* wrapper, LlamaSession& session,
+                              std::vector<llama_token>& turn, int n_reply, int capacity = -1) {
+    TRACE_SECTION("llama:make_room");
+    if (capacity < 0) capacity = wrapper->context_size;
+    int n_evicted = 0;
+    while ((int)(session.tokens.size() + turn.size()) + n_reply > capacity &&
+           !session.turn_starts.empty()) {
+        session_evict_oldest_turn(wrapper, session);
+        n_evicted++;
+    }
+    if (n_evicted > 0) {
+        log_android(LOG_TAG, "♻️ Context shift: evicted " + std::to_string(n_evicted) + " old turns, " +
+                             std::to_string(session.tokens.size()) + " tokens kept");
+    }
+
+    int room = capacity - n_reply - (int)session.tokens.size();
+    if ((int)turn.size() > room) {
+        size_t n_drop = turn.size() - (size_t)std::max(room, 1);
+        turn.erase(turn.begin(), turn.begin() + n_drop);
+        log_android(LOG_TAG, "✂️ Prompt too long, dropped its first " + std::to_string(n_drop) + " tokens");
+    }
+}
+
+// KV cells no sequence holds. Sessions share one cache, so a session can only grow into
+// these plus the cells of its own turns, whatever context_size says.
+static int kv_free_cells(const LlamaModelWrapper* wrapper) {
+    return std::max(0, wrapper->context_size - llama_get_kv_cache_used_cells((llama_context*)wrapper->ctx));
+}
+
+// Bring the KV cache in line with `target`: keep the longest common prefix,
+// truncate whatever diverges and decode only the remaining delta.
+static DecodeStatus session_sync(LlamaModelWrapper* wrapper, std::vector<llama_token>& target,
+                                 const ProgressCallback& on_progress = ProgressCallback()) {
+    LlamaSession& session = wrapper->session;
+    size_t n_keep = session_rewind(wrapper, session, target);
+
+    return session_decode(wrapper, session, target.data() + n_keep, (int)(target.size() - n_keep), on_progress);
+}
+
+// Revoke a pending prefillPartial turn: its cells go, everything before it stays cached
+static void discard_partial_prefill(LlamaModelWrapper* wrapper) {
+    if (wrapper->partial_start < 0) return;
+
+    LlamaSession& session = wrapper->session;
+    size_t n_base = (size_t)wrapper->partial_start;
+    wrapper->partial_start = -1;
+    if (session.tokens.size() > n_base) {
+        llama_kv_cache_seq_rm((llama_context*)wrapper->ctx, session.seq_id, (llama_pos)n_base, -1);
+        session.tokens.resize(n_base);
+    }
+}
+
+// Identifies the weights the KV cells were computed with: 0 for the base model, otherwise
+// a hash of the applied adapter and its scale. Stored with every persisted state.
+static uint32_t lora_state_id(const LlamaModelWrapper* wrapper) {
+    if (wrapper->lora_path.empty()) return 0;
+    size_t h = std::hash<std::string>()(wrapper->lora_path + "@" + std::to_string(wrapper->lora_scale));
+    return (uint32_t)(h ^ (h >> 32)) | 1u;
+}
+
+// Identifies the base weights: a hash of their shape, parameter count and tensor bytes, so a
+// different GGUF that happens to share the system prompt and KV types is told apart
+static uint64_t model_fingerprint(const LlamaModelWrapper* wrapper) {
+    const llama_model* model = (const llama_model*)wrapper->model;
+    std::string shape = std::to_string(llama_n_vocab(model)) + "/" + std::to_string(llama_n_embd(model)) + "/" +
+                        std::to_string(llama_n_layer(model)) + "/" +
+                        std::to_string((unsigned long long)llama_model_n_params(model)) + "/" +
+                        std::to_string((unsigned long long)llama_model_size(model));
+    return (uint64_t)std::hash<std::string>()(shape);
+}
+
+// Try to restore the prefix KV entries saved by a previous run of the app
+static bool load_prefix_state(LlamaModelWrapper* wrapper, const std::string& state_path) {
+    std::vector<llama_token> saved(wrapper->prefix_tokens.size());
+    size_t n_saved = 0;
+
+    size_t n_read = llama_state_seq_load_file(
+            (llama_context*)wrapper->ctx,
+            state_path.c_str(),
+            PREFIX_SEQ_ID,
+            saved.data(),
+            saved.size(),
+            &n_saved
+    );
+    if (n_read == 0) {
+        return false;
+    }
+
+    saved.resize(n_saved);
+    if (saved != wrapper->prefix_tokens) {
+        // Prompt changed since the file was written - the cached state is stale
+        llama_kv_cache_seq_rm((llama_context*)wrapper->ctx, PREFIX_SEQ_ID, -1, -1);
+        return false;
+    }
+    return true;
+}
+
+// Decode the fixed system preamble once so every turn only pays for its own tokens
+static bool prepare_prefix_cache(LlamaModelWrapper* wrapper) {
+    TRACE_SECTION("llama:prefix_cache");
+    wrapper->prefix_tokens = wrapper->chat_template.system_prefix;
+    wrapper->n_prefix = 0;
+    wrapper->partial_start = -1;
+    wrapper->session.tokens.clear();
+    wrapper->session.turn_starts.clear();
+    wrapper->session.n_turns = 0;
+    if (wrapper->prefix_tokens.empty()) {
+        return false;
+    }
+
+    llama_kv_cache_clear((llama_context*)wrapper->ctx);
+
+    // The saved cells are only valid for the KV types they were written with
+    std::string state_path = wrapper->model_path + "." + ggml_type_name(wrapper->kv_config.type_k) + "-" +
+                             ggml_type_name(wrapper->kv_config.type_v);
+    if (lora_state_id(wrapper) != 0) {
+        char tag[16];
+        snprintf(tag, sizeof(tag), ".lora-%08x", lora_state_id(wrapper));
+        state_path += tag;
+    }
+    state_path += PREFIX_STATE_SUFFIX;
+    if (load_prefix_state(wrapper, state_path)) {
+        wrapper->n_prefix = (int)wrapper->prefix_tokens.size();
+        wrapper->session.tokens = wrapper->prefix_tokens;
+        log_android(LOG_TAG, "💾 Restored system prefix from " + state_path);
+        return true;
+    }
+
+    if (session_decode(wrapper, wrapper->prefix_tokens.data(), (int)wrapper->prefix_tokens.size()) != DECODE_OK) {
+        log_android(LOG_TAG, "❌ Failed to evaluate system prefix");
+        llama_kv_cache_clear((llama_context*)wrapper->ctx);
+        wrapper->session.tokens.clear();
+        return false;
+    }
+    wrapper->n_prefix = (int)wrapper->prefix_tokens.size();
+
+    // Best effort: a read-only model directory just means we decode again next launch
+    if (llama_state_seq_save_file((llama_context*)wrapper->ctx, state_path.c_str(), PREFIX_SEQ_ID,
+                                  wrapper->prefix_tokens.data(), wrapper->prefix_tokens.size()) == 0) {
+        log_android(LOG_TAG, "⚠️ Could not persist system prefix state");
+    }
+    return true;
+}
+
+// saveSession file: header, token history, turn boundaries, then the raw seq 0 KV state
+struct SessionFileHeader {
+    uint32_t magic;
+    uint32_t version;
+    int32_t type_k;
+    int32_t type_v;
+    uint32_t n_tokens;
+    uint32_t n_turns;
+    uint32_t n_turn_starts;
+    uint32_t adapter_id;
+    uint64_t model_id; // model_fingerprint
+    uint64_t state_size;
+};
+
+// Write the main conversation through a shared mapping so llama_state_seq_get_data fills
+// the file pages directly. The file is built next to the target and renamed over it, so a
+// kill mid-write leaves the previous save intact. A pending partial turn is not part of the
+// conversation and is dropped first. Caller holds ctx_mutex.
+static bool save_session(LlamaModelWrapper* wrapper, const std::string& path) {
+    TRACE_SECTION("llama:save_session");
+    llama_context* ctx = (llama_context*)wrapper->ctx;
+    discard_partial_prefill(wrapper);
+    const LlamaSession& session = wrapper->session;
+
+    if (path == wrapper->saved_session_path && session.tokens == wrapper->saved_session_tokens) {
+        return true; // nothing new since the last save
+    }
+
+    SessionFileHeader header;
+    header.magic = SESSION_FILE_MAGIC;
+    header.version = SESSION_FILE_VERSION;
+    header.type_k = (int32_t)wrapper->kv_config.type_k;
+    header.type_v = (int32_t)wrapper->kv_config.type_v;
+    header.n_tokens = (uint32_t)session.tokens.size();
+    header.n_turns = (uint32_t)session.n_turns;
+    header.n_turn_starts = (uint32_t)session.turn_starts.size();
+    header.adapter_id = lora_state_id(wrapper);
+    header.model_id = model_fingerprint(wrapper);
+    header.state_size = llama_state_seq_get_size(ctx, session.seq_id);
+
+    size_t tokens_bytes = session.tokens.size() * sizeof(llama_token);
+    size_t turns_bytes = session.turn_starts.size() * sizeof(uint64_t);
+    size_t state_offset = sizeof(header) + tokens_bytes + turns_bytes;
+    size_t capacity = state_offset + header.state_size;
+
+    const std::string tmp_path = path + ".tmp";
+    int fd = open(tmp_path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+    if (fd < 0) {
+        log_android(LOG_TAG, "❌ Cannot create " + tmp_path);
+        return false;
+    }
+    if (ftruncate(fd, (off_t)capacity) != 0) {
+        close(fd);
+        unlink(tmp_path.c_str());
+        return false;
+    }
+
+    void* addr = mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED) {
+        close(fd);
+        unlink(tmp_path.c_str());
+        return false;
+    }
+
+    uint8_t* out = (uint8_t*)addr;
+    size_t n_state = llama_state_seq_get_data(ctx, out + state_offset, header.state_size, session.seq_id);
+    header.state_size = n_state;
+
+    memcpy(out, &header, sizeof(header));
+    if (tokens_bytes > 0) {
+        memcpy(out + sizeof(header), session.tokens.data(), tokens_bytes);
+    }
+    uint64_t* turns = (uint64_t*)(out + sizeof(header) + tokens_bytes);
+    for (size_t i = 0; i < session.turn_starts.size(); i++) {
+        turns[i] = (uint64_t)session.turn_starts[i];
+    }
+    munmap(addr, capacity);
+
+    bool ok = n_state > 0 && ftruncate(fd, (off_t)(state_offset + n_state)) == 0;
+    close(fd);
+    if (!ok || std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+        unlink(tmp_path.c_str());
+        log_android(LOG_TAG, "❌ Failed to save session to " + path);
+        return false;
+    }
+
+    wrapper->saved_session_path = path;
+    wrapper->saved_session_tokens = session.tokens;
+    log_android(LOG_TAG, "💾 Saved " + std::to_string(session.tokens.size()) + " tokens (" +
+                         std::to_string((state_offset + n_state) / 1024) + " KiB) to " + path);
+    return true;
+}
+
+// Map a saveSession file read-only and hand the KV bytes to llama straight from the page
+// cache. Rejected unless it was written by the same model with the same KV types, adapter
+// and system prefix, and its turn boundaries are consistent. Caller holds ctx_mutex.
+static bool load_session(LlamaModelWrapper* wrapper, const std::string& path) {
+    TRACE_SECTION("llama:load_session");
+    llama_context* ctx = (llama_context*)wrapper->ctx;
+    discard_partial_prefill(wrapper);
+    LlamaSession& session = wrapper->session;
+
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(SessionFileHeader)) {
+        close(fd);
+        return false;
+    }
+    size_t size = (size_t)st.st_size;
+    void* addr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) return false;
+
+    const uint8_t* in = (const uint8_t*)addr;
+    SessionFileHeader header;
+    memcpy(&header, in, sizeof(header));
+
+    size_t tokens_bytes = (size_t)header.n_tokens * sizeof(llama_token);
+    size_t turns_bytes = (size_t)header.n_turn_starts * sizeof(uint64_t);
+    size_t state_offset = sizeof(header) + tokens_bytes + turns_bytes;
+
+    bool ok = header.magic == SESSION_FILE_MAGIC && header.version == SESSION_FILE_VERSION &&
+              header.type_k == (int32_t)wrapper->kv_config.type_k &&
+              header.type_v == (int32_t)wrapper->kv_config.type_v &&
+              header.adapter_id == lora_state_id(wrapper) &&
+              header.model_id == model_fingerprint(wrapper) &&
+              header.n_tokens <= (uint32_t)wrapper->context_size &&
+              header.n_turn_starts <= header.n_turns && header.n_turn_starts <= header.n_tokens &&
+              state_offset + header.state_size == size;
+
+    std::vector<llama_token> tokens;
+    std::vector<size_t> turn_starts;
+    if (ok) {
+        tokens.resize(header.n_tokens);
+        if (tokens_bytes > 0) memcpy(tokens.data(), in + sizeof(header), tokens_bytes);
+
+        // The saved KV only continues this conversation if it starts with today's preamble
+        ok = tokens.size() >= wrapper->prefix_tokens.size() &&
+             std::equal(wrapper->prefix_tokens.begin(), wrapper->prefix_tokens.end(), tokens.begin());
+    }
+    if (ok) {
+        const uint8_t* turns = in + sizeof(header) + tokens_bytes;
+        // Eviction trusts these: strictly ascending, inside the history and past the prefix
+        uint64_t previous = 0;
+        for (uint32_t i = 0; ok && i < header.n_turn_starts; i++) {
+            uint64_t start;
+            memcpy(&start, turns + i * sizeof(uint64_t), sizeof(start));
+            ok = start >= wrapper->prefix_tokens.size() && start < header.n_tokens && (i == 0 || start > previous);
+            previous = start;
+            turn_starts.push_back((size_t)start);
+        }
+    }
+    if (ok) {
+        ok = llama_state_seq_set_data(ctx, in + state_offset, (size_t)header.state_size, session.seq_id) != 0;
+        if (!ok) {
+            // The failed restore may have dropped the cached prefix along with the old cells
+            llama_kv_cache_seq_rm(ctx, session.seq_id, -1, -1);
+            session.tokens.clear();
+            session.turn_starts.clear();
+            session.n_turns = 0;
+            session_decode(wrapper, session, wrapper->prefix_tokens.data(), (int)wrapper->prefix_tokens.size());
+        }
+    }
+    munmap(addr, size);
+
+    if (!ok) {
+        log_android(LOG_TAG, "⚠️ Ignoring incompatible session file " + path);
+        return false;
+    }
+
+    session.tokens.swap(tokens);
+    session.turn_starts.swap(turn_starts);
+    session.n_turns = (int)header.n_turns;
+    wrapper->saved_session_path = path;
+    wrapper->saved_session_tokens = session.tokens;
+    log_android(LOG_TAG, "💾 Restored " + std::to_string(session.tokens.size()) + " tokens from " + path);
+    return true;
+}
+
+// Sentence boundaries for the speech pipeline
+static const char* ABBREVIATIONS[] = {
+        "sr", "sra", "srta", "dr", "dra", "ud", "uds", "lic", "ing", "prof", "av", "ej", "vs", "aprox"
+};
+
+static bool is_abbreviation(const std::string& text, size_t dot_pos) {
+    size_t start = dot_pos;
+    while (start > 0 && !isspace((unsigned char)text[start - 1])) {
+        start--;
+    }
+
+    std::string word;
+    for (size_t i = start; i < dot_pos; i++) {
+        if (text[i] == '(' || text[i] == '"' || text[i] == '\'') continue;
+        word += (char)tolower((unsigned char)text[i]);
+    }
+
+    // Single-letter initials ("J. Pérez") never end a sentence
+    if (word.size() == 1 && isalpha((unsigned char)word[0])) return true;
+
+    for (size_t i = 0; i < sizeof(ABBREVIATIONS) / sizeof(ABBREVIATIONS[0]); i++) {
+        if (word == ABBREVIATIONS[i]) return true;
+    }
+    return false;
+}
+
+// Length of a sentence terminator at `pos`: . ! ? or the ellipsis character …
+static size_t terminator_len(const std::string& text, size_t pos) {
+    char c = text[pos];
+    if (c == '.' || c == '!' || c == '?') return 1;
+    if (text.compare(pos, 3, "\xE2\x80\xA6") == 0) return 3;
+    return 0;
+}
+
+// Closing quotes and brackets that belong to the sentence they follow
+static size_t closer_len(const std::string& text, size_t pos) {
+    char c = text[pos];
+    if (c == '"' || c == '\'' || c == ')') return 1;
+    if (text.compare(pos, 2, "\xC2\xBB") == 0) return 2;     // »
+    if (text.compare(pos, 3, "\xE2\x80\x9D") == 0) return 3; // ”
+    return 0;
+}
+
+void SentenceSplitter::emit(size_t end, std::vector<std::string>& out) {
+    size_t first = 0;
+    while (first < end && isspace((unsigned char)buffer[first])) first++;
+    size_t last = end;
+    while (last > first && isspace((unsigned char)buffer[last - 1])) last--;
+
+    if (last > first) {
+        out.push_back(buffer.substr(first, last - first));
+    }
+    buffer.erase(0, end);
+    scan_pos = 0;
+}
+
+void SentenceSplitter::feed(const char* text, size_t len, std::vector<std::string>& out) {
+    buffer.append(text, len);
+
+    size_t i = scan_pos;
+    while (i < buffer.size()) {
+        if (buffer[i] == '\n') {
+            emit(i + 1, out);
+            i = 0;
+            continue;
+        }
+
+        size_t term = terminator_len(buffer, i);
+        if (term == 0) {
+            i++;
+            continue;
+        }
+
+        // Absorb runs like "?!" or "..." plus any closing quotes
+        size_t end = i + term;
+        while (end < buffer.size()) {
+            size_t n = terminator_len(buffer, end);
+            if (n == 0) n = closer_len(buffer, end);
+            if (n == 0) break;
+            end += n;
+        }
+
+        // Need one more character to know whether this really ends the sentence
+        if (end >= buffer.size()) break;
+
+        // "3.5", "www.ejemplo.com" and abbreviations are not boundaries
+        bool boundary = isspace((unsigned char)buffer[end]) != 0;
+        if (boundary && term == 1 && buffer[i] == '.' && end == i + 1 && is_abbreviation(buffer, i)) {
+            boundary = false;
+        }
+
+        if (boundary) {
+            emit(end, out);
+            i = 0;
+        } else {
+            i = end;
+        }
+    }
+    scan_pos = i;
+}
+
+void SentenceSplitter::flush(std::vector<std::string>& out) {
+    emit(buffer.size(), out);
+}
+
+// Build top-k -> top-p -> temperature -> dist. Top-k goes first so its partial sort
+// shrinks the ~256k Gemma candidates before top-p has to softmax and sort them.
+static llama_sampler* create_sampler_chain(const SamplerConfig& config, int vocab_size) {
+    llama_sampler_chain_params chain_params = llama_sampler_chain_default_params();
+    chain_params.no_perf = true;
+    llama_sampler* chain = llama_sampler_chain_init(chain_params);
+
+    if (config.temperature <= 0.0f) {
+        llama_sampler_chain_add(chain, llama_sampler_init_greedy());
+        return chain;
+    }
+
+    // top_k <= 0 or >= the vocab means "no top-k", as in llama.cpp's own samplers
+    if (config.top_k > 0 && config.top_k < vocab_size) {
+        llama_sampler_chain_add(chain, llama_sampler_init_top_k(config.top_k));
+    }
+    if (config.top_p > 0.0f && config.top_p < 1.0f) {
+        llama_sampler_chain_add(chain, llama_sampler_init_top_p(config.top_p, 1));
+    }
+    llama_sampler_chain_add(chain, llama_sampler_init_temp(config.temperature));
+    llama_sampler_chain_add(chain, llama_sampler_init_dist(config.seed));
+    return chain;
+}
+
+static bool init_sampler(LlamaModelWrapper* wrapper) {
+    if (wrapper->sampler) {
+        llama_sampler_free(wrapper->sampler);
+    }
+    wrapper->sampler = create_sampler_chain(wrapper->sampler_config, wrapper->vocab_size);
+    wrapper->candidates.resize(wrapper->vocab_size);
+    wrapper->penalized.assign(wrapper->vocab_size, 0);
+    return wrapper->sampler != nullptr;
+}
+
+// Repetition penalty straight on the raw logits (candidates[i].id == i at this point),
+// touching only the recent tokens instead of the whole vocab
+static void apply_repetition_penalty(LlamaModelWrapper* wrapper, llama_token_data* candidates,
+                                     const std::vector<llama_token>& history) {
+    const SamplerConfig& config = wrapper->sampler_config;
+    if (config.repeat_penalty == 1.0f || config.repeat_last_n <= 0) return;
+
+    size_t first = history.size() > (size_t)config.repeat_last_n ? history.size() - config.repeat_last_n : 0;
+
+    for (size_t i = first; i < history.size(); i++) {
+        llama_token token = history[i];
+        if (token < 0 || token >= wrapper->vocab_size || wrapper->penalized[token]) continue;
+        wrapper->penalized[token] = 1;
+
+        float& logit = candidates[token].logit;
+        logit = logit > 0.0f ? logit / config.repeat_penalty : logit * config.repeat_penalty;
+    }
+    for (size_t i = first; i < history.size(); i++) {
+        llama_token token = history[i];
+        if (token >= 0 && token < wrapper->vocab_size) wrapper->penalized[token] = 0;
+    }
+}
+
+// Sample from the logits at batch index `logits_index` using the preallocated candidate
+// buffer; `history` is the sequence the penalty looks back over
+static llama_token sample_next_token(LlamaModelWrapper* wrapper, int logits_index,
+                                     const std::vector<llama_token>& history) {
+    TRACE_SECTION("llama:sample");
+    const float* logits = llama_get_logits_ith((llama_context*)wrapper->ctx, logits_index);
+    llama_token_data* candidates = wrapper->candidates.data();
+
+    for (int i = 0; i < wrapper->vocab_size; i++) {
+        candidates[i].id = i;
+        candidates[i].logit = logits[i];
+        candidates[i].p = 0.0f;
+    }
+    apply_repetition_penalty(wrapper, candidates, history);
+
+    llama_token_data_array candidate_array = { candidates, (size_t)wrapper->vocab_size, -1, false };
+    llama_sampler_apply(wrapper->sampler, &candidate_array);
+
+    llama_token token = candidate_array.data[candidate_array.selected].id;
+    llama_sampler_accept(wrapper->sampler, token);
+    return token;
+}
+
+static llama_token sample_next_token(LlamaModelWrapper* wrapper) {
+    return sample_next_token(wrapper, -1, wrapper->session.tokens);
+}
+
+// Cores for decode and prefill under a given policy
+struct ThreadPlan {
+    std::vector<int> decode_cores;
+    std::vector<int> batch_cores;
+    uint32_t poll;
+};
+
+static ThreadPlan plan_threads(const CpuTopology& topology, ThreadPolicy policy) {
+    ThreadPlan plan;
+
+    if (policy == THREAD_POLICY_BACKGROUND && !topology.little.empty()) {
+        plan.decode_cores = topology.little;
+        plan.batch_cores = topology.little;
+        plan.poll = 0; // sleep instead of spinning while waiting for work
+        return plan;
+    }
+
+    // Decode: fastest cores first, capped since it is memory-bandwidth bound.
+    // Prefill is compute bound and gets every core.
+    std::vector<int> performance = topology.performance_cores();
+    size_t n_decode = std::min(performance.size(), (size_t)MAX_DECODE_THREADS);
+    plan.decode_cores.assign(performance.begin(), performance.begin() + n_decode);
+    plan.batch_cores = topology.all_cores();
+    plan.poll = policy == THREAD_POLICY_BACKGROUND ? 0 : 50;
+    return plan;
+}
+
+static ggml_threadpool* create_threadpool(const std::vector<int>& cores, uint32_t poll) {
+    ggml_threadpool_params params = ggml_threadpool_params_default((int)cores.size());
+    memset(params.cpumask, 0, sizeof(params.cpumask));
+    for (size_t i = 0; i < cores.size(); i++) {
+        if (cores[i] >= 0 && cores[i] < GGML_MAX_N_THREADS) params.cpumask[cores[i]] = true;
+    }
+    params.strict_cpu = true; // one thread per core in the mask
+    params.poll = poll;
+    return ggml_threadpool_new(&params);
+}
+
+static void free_threadpools(LlamaModelWrapper* wrapper) {
+    if (wrapper->ctx) {
+        llama_detach_threadpool((llama_context*)wrapper->ctx);
+    }
+    if (wrapper->threadpool) ggml_threadpool_free(wrapper->threadpool);
+    if (wrapper->threadpool_batch) ggml_threadpool_free(wrapper->threadpool_batch);
+    wrapper->threadpool = nullptr;
+    wrapper->threadpool_batch = nullptr;
+}
+
+// Swap in pinned threadpools for `policy`; only call while no decode is running
+static bool apply_thread_policy(LlamaModelWrapper* wrapper, ThreadPolicy policy) {
+    ThreadPlan plan = plan_threads(wrapper->cpu_topology, policy);
+
+    ggml_threadpool* threadpool = create_threadpool(plan.decode_cores, plan.poll);
+    ggml_threadpool* threadpool_batch = create_threadpool(plan.batch_cores, plan.poll);
+    if (threadpool == nullptr || threadpool_batch == nullptr) {
+        if (threadpool) ggml_threadpool_free(threadpool);
+        if (threadpool_batch) ggml_threadpool_free(threadpool_batch);
+        log_android(LOG_TAG, "⚠️ Could not create threadpools, keeping previous thread policy");
+        return false;
+    }
+
+    free_threadpools(wrapper);
+    wrapper->threadpool = threadpool;
+    wrapper->threadpool_batch = threadpool_batch;
+    llama_attach_threadpool((llama_context*)wrapper->ctx, threadpool, threadpool_batch);
+    llama_set_n_threads((llama_context*)wrapper->ctx, (int)plan.decode_cores.size(), (int)plan.batch_cores.size());
+    wrapper->active_thread_policy = policy;
+
+    log_android(LOG_TAG, "🧵 Thread policy " + std::to_string(policy) + ": decode=" +
+                         std::to_string(plan.decode_cores.size()) + " prefill=" +
+                         std::to_string(plan.batch_cores.size()) + " threads");
+    return true;
+}
+
+static void sync_thread_policy(LlamaModelWrapper* wrapper) {
+    int requested = wrapper->requested_thread_policy.load();
+    if (requested != wrapper->active_thread_policy) {
+        apply_thread_policy(wrapper, (ThreadPolicy)requested);
+    }
+}
+
+// Length of the longest prefix of `bytes` that ends on a UTF-8 character boundary
+static size_t utf8_complete_prefix(const std::string& bytes) {
+    size_t n = bytes.size();
+    for (size_t back = 1; back <= 4 && back <= n; back++) {
+        unsigned char c = (unsigned char)bytes[n - back];
+        if ((c & 0xC0) == 0x80) continue; // continuation byte, keep looking for the lead
+
+        size_t need = (c & 0x80) == 0x00 ? 1 :
+                      (c & 0xE0) == 0xC0 ? 2 :
+                      (c & 0xF0) == 0xE0 ? 3 :
+                      (c & 0xF8) == 0xF0 ? 4 : 1;
+        return back >= need ? n : n - back;
+    }
+    return n;
+}
+
+// Append the text of a token, growing the buffer for unusually long pieces
+static void append_token_piece(LlamaModelWrapper* wrapper, llama_token token, std::string& out) {
+    TRACE_SECTION("llama:token_to_piece");
+    char token_str[256];
+    int token_len = llama_token_to_piece(
+            (llama_model*)wrapper->model,
+            token,
+            token_str,
+            sizeof(token_str),
+            0,
+            true
+    );
+
+    if (token_len >= 0) {
+        out.append(token_str, token_len);
+        return;
+    }
+
+    std::vector<char> big(-token_len);
+    token_len = llama_token_to_piece((llama_model*)wrapper->model, token, big.data(), big.size(), 0, true);
+    if (token_len > 0) {
+        out.append(big.data(), token_len);
+    }
+}
+
+// Tokens for a new user turn following the first n_base tokens of the session. The system
+// prefix is never re-tokenized: if nothing is cached yet its stored tokens are reused.
+static std::vector<llama_token> tokenize_turn(LlamaModelWrapper* wrapper, const LlamaSession& session,
+                                              size_t n_base, const std::string& user_input) {
+    const ChatTemplate& tpl = wrapper->chat_template;
+    std::vector<llama_token> text = tokenize_text(wrapper, user_input, false, false);
+
+    std::vector<llama_token> tokens;
+    if (n_base == 0) {
+        tokens.reserve(tpl.system_prefix.size() + tpl.first_user_open.size() + text.size() + tpl.model_open.size());
+        tokens.insert(tokens.end(), tpl.system_prefix.begin(), tpl.system_prefix.end());
+        tokens.insert(tokens.end(), tpl.first_user_open.begin(), tpl.first_user_open.end());
+    } else {
+        const std::vector<llama_token>& open = session.n_turns > 0 ? tpl.user_open : tpl.first_user_open;
+        tokens.reserve(open.size() + text.size() + tpl.model_open.size());
+        tokens.insert(tokens.end(), open.begin(), open.end());
+    }
+    tokens.insert(tokens.end(), text.begin(), text.end());
+    tokens.insert(tokens.end(), tpl.model_open.begin(), tpl.model_open.end());
+    return tokens;
+}
+
+static std::vector<llama_token> tokenize_turn(LlamaModelWrapper* wrapper, const LlamaSession& session,
+                                              const std::string& user_input) {
+    return tokenize_turn(wrapper, session, session.tokens.size(), user_input);
+}
+
+// Main-session turn. A pending partial turn is not history: the new turn replaces it.
+static std::vector<llama_token> tokenize_turn(LlamaModelWrapper* wrapper, const std::string& user_input) {
+    size_t n_base = wrapper->partial_start >= 0 ? (size_t)wrapper->partial_start : wrapper->session.tokens.size();
+    return tokenize_turn(wrapper, wrapper->session, n_base, user_input);
+}
+
+// Speculatively decode a partial transcript as the next user turn while the user is still
+// speaking. Each update is synced to the longest common token prefix with the previous one,
+// so a revision only re-decodes its tail, and the final run_chat_turn starts from whatever
+// still matches. Returns the speculative tokens now cached, or -1 on failure.
+static int prefill_partial(LlamaModelWrapper* wrapper, const std::string& text) {
+    TRACE_SECTION("llama:partial_prefill");
+    RequestLock lock(wrapper);
+    if (!ensure_context(wrapper)) return -1;
+    sync_thread_policy(wrapper);
+
+    LlamaSession& session = wrapper->session;
+    if (wrapper->partial_start < 0) {
+        wrapper->partial_start = (int)session.tokens.size();
+    }
+    size_t n_base = (size_t)wrapper->partial_start;
+
+    std::vector<llama_token> tokens = tokenize_turn(wrapper, text);
+    if (tokens.empty()) return 0;
+    if ((int)(n_base + tokens.size()) + MAX_RESPONSE_TOKENS > wrapper->context_size) {
+        // Evicting history for a guess is not worth it; the final turn does the context shift
+        discard_partial_prefill(wrapper);
+        return 0;
+    }
+
+    std::vector<llama_token> target(session.tokens.begin(), session.tokens.begin() + n_base);
+    target.insert(target.end(), tokens.begin(), tokens.end());
+    auto n_evaluated = wrapper->n_evaluated;
+    if (session_sync(wrapper, target) == DECODE_FAILED) {
+        discard_partial_prefill(wrapper);
+        return -1;
+    }
+
+    int n_cached = (int)(session.tokens.size() - n_base);
+    log_android(LOG_TAG, "🎙️ Partial prefill: " + std::to_string(n_cached) + " speculative tokens (" +
+                         std::to_string((long long)(wrapper->n_evaluated - n_evaluated)) + " decoded)");
+    return n_cached;
+}
+
+// Prompt lookup: find the latest earlier occurrence of the history's last n-gram and
+// propose whatever followed it. Costs no model evaluation at all.
+static void propose_prompt_lookup(const std::vector<llama_token>& history, int max_draft,
+                                  std::vector<llama_token>& draft) {
+    int n_hist = (int)history.size();
+    for (int n = SPEC_LOOKUP_MAX_NGRAM; n >= SPEC_LOOKUP_MIN_NGRAM; n--) {
+        if (n_hist <= n) continue;
+        const llama_token* tail = history.data() + n_hist - n;
+
+        for (int start = n_hist - n - 1; start >= 0; start--) {
+            if (!std::equal(tail, tail + n, history.data() + start)) continue;
+
+            int from = start + n;
+            int count = std::min(max_draft, n_hist - from);
+            draft.assign(history.begin() + from, history.begin() + from + count);
+            return;
+        }
+    }
+}
+
+// Bring the draft context in line with `history` (common prefix kept) and decode the rest
+static bool draft_sync(DraftModel& draft, const std::vector<llama_token>& history) {
+    size_t n_keep = 0;
+    while (n_keep < draft.tokens.size() && n_keep < history.size() && draft.tokens[n_keep] == history[n_keep]) {
+        n_keep++;
+    }
+    if (n_keep == history.size() && n_keep > 0) {
+        n_keep--; // logits of the last token are needed again
+    }
+    if (n_keep < draft.tokens.size()) {
+        llama_kv_cache_seq_rm(draft.ctx, 0, (llama_pos)n_keep, -1);
+        draft.tokens.resize(n_keep);
+    }
+
+    for (size_t start = n_keep; start < history.size(); start += draft.batch_capacity) {
+        int n = (int)std::min((size_t)draft.batch_capacity, history.size() - start);
+        draft.batch.n_tokens = n;
+        for (int i = 0; i < n; i++) {
+            draft.batch.token[i] = history[start + i];
+            draft.batch.pos[i] = (llama_pos)(start + i);
+            draft.batch.n_seq_id[i] = 1;
+            draft.batch.seq_id[i][0] = 0;
+            draft.batch.logits[i] = (start + i == history.size() - 1);
+        }
+        if (llama_decode(draft.ctx, draft.batch) != 0) {
+            llama_kv_cache_seq_rm(draft.ctx, 0, (llama_pos)start, -1);
+            return false;
+        }
+        draft.tokens.insert(draft.tokens.end(), history.begin() + start, history.begin() + start + n);
+    }
+    return true;
+}
+
+// Greedy continuation of `history` by the draft model
+static void propose_draft_model(LlamaModelWrapper* wrapper, const std::vector<llama_token>& history,
+                                int max_draft, std::vector<llama_token>& draft_tokens) {
+    TRACE_SECTION("llama:draft");
+    DraftModel& draft = wrapper->draft;
+    if (draft.ctx == nullptr || !draft_sync(draft, history)) return;
+
+    int n_vocab = wrapper->vocab_size;
+    for (int i = 0; i < max_draft; i++) {
+        const float* logits = llama_get_logits_ith(draft.ctx, -1);
+        llama_token token = (llama_token)(std::max_element(logits, logits + n_vocab) - logits);
+        if (is_end_of_turn(wrapper, token)) break;
+        draft_tokens.push_back(token);
+        if (i + 1 == max_draft) break;
+
+        draft.batch.n_tokens = 1;
+        draft.batch.token[0] = token;
+        draft.batch.pos[0] = (llama_pos)draft.tokens.size();
+        draft.batch.n_seq_id[0] = 1;
+        draft.batch.seq_id[0][0] = 0;
+        draft.batch.logits[0] = true;
+        if (llama_decode(draft.ctx, draft.batch) != 0) break;
+        draft.tokens.push_back(token);
+    }
+}
+
+// Tokens the main model should check after `history`, empty when speculation is off
+static void propose_draft(LlamaModelWrapper* wrapper, const std::vector<llama_token>& history, int max_draft,
+                          std::vector<llama_token>& draft) {
+    draft.clear();
+    if (max_draft <= 0) return;
+
+    if (wrapper->spec_mode == SPEC_MODE_PROMPT_LOOKUP) {
+        propose_prompt_lookup(history, max_draft, draft);
+    } else if (wrapper->spec_mode == SPEC_MODE_DRAFT_MODEL) {
+        propose_draft_model(wrapper, history, max_draft, draft);
+    }
+}
+
+// Decode `token` plus the draft in one batch with logits on every row, so row i predicts
+// what follows draft[i - 1]. On failure the session is left exactly as before.
+static DecodeStatus decode_with_draft(LlamaModelWrapper* wrapper, LlamaSession& session, llama_token token,
+                                      const std::vector<llama_token>& draft) {
+    TRACE_SECTION("llama:decode_verify");
+    llama_batch& batch = wrapper->batch;
+    llama_pos pos = (llama_pos)session.tokens.size();
+    int n = 1 + (int)draft.size();
+
+    batch.n_tokens = n;
+    for (int i = 0; i < n; i++) {
+        batch.token[i] = i == 0 ? token : draft[i - 1];
+        batch.pos[i] = pos + i;
+        batch.n_seq_id[i] = 1;
+        batch.seq_id[i][0] = session.seq_id;
+        batch.logits[i] = true;
+    }
+
+    int ret = llama_decode((llama_context*)wrapper->ctx, batch);
+    if (ret != 0) {
+        llama_kv_cache_seq_rm((llama_context*)wrapper->ctx, session.seq_id, pos, -1);
+        return ret == 2 || cancel_pending(wrapper) ? DECODE_CANCELLED : DECODE_FAILED;
+    }
+    session.tokens.push_back(token);
+    session.tokens.insert(session.tokens.end(), draft.begin(), draft.end());
+    wrapper->n_evaluated += n;
+    return DECODE_OK;
+}
+
+// Drop the rejected tail of a verification batch from the cache and the session
+static void session_truncate(LlamaModelWrapper* wrapper, LlamaSession& session, size_t n_tokens) {
+    if (n_tokens >= session.tokens.size()) return;
+    llama_kv_cache_seq_rm((llama_context*)wrapper->ctx, session.seq_id, (llama_pos)n_tokens, -1);
+    session.tokens.resize(n_tokens);
+}
+
+// Wall-clock marks of one request, turned into the metrics array when it finishes
+struct TurnClock {
+    typedef std::chrono::steady_clock clock;
+
+    clock::time_point start;
+    clock::time_point prefill_end;
+    clock::time_point first_token;
+    bool has_first_token;
+    uint64_t evaluated_at_start;
+    int n_prefill;
+    int n_generated;
+
+    explicit TurnClock(LlamaModelWrapper* wrapper)
+            : start(clock::now()), prefill_end(start), first_token(start), has_first_token(false),
+              evaluated_at_start(wrapper->n_evaluated), n_prefill(0), n_generated(0) {
+        llama_perf_context_reset((llama_context*)wrapper->ctx);
+    }
+
+    void prefill_done(LlamaModelWrapper* wrapper) {
+        prefill_end = clock::now();
+        n_prefill = (int)(wrapper->n_evaluated - evaluated_at_start);
+    }
+
+    void token_sampled() {
+        if (!has_first_token) {
+            first_token = clock::now();
+            has_first_token = true;
+        }
+        n_generated++;
+    }
+};
+
+static double elapsed_ms(TurnClock::clock::time_point from, TurnClock::clock::time_point to) {
+    return std::chrono::duration<double, std::milli>(to - from).count();
+}
+
+static double tokens_per_second(double n_tokens, double ms) {
+    return ms > 0.0 ? n_tokens * 1000.0 / ms : 0.0;
+}
+
+static double peak_rss_kb() {
+    struct rusage usage;
+    return getrusage(RUSAGE_SELF, &usage) == 0 ? (double)usage.ru_maxrss : 0.0; // KB on Linux
+}
+
+// Publish the finished request's numbers for getInferenceMetrics
+static void record_metrics(LlamaModelWrapper* wrapper, const TurnClock& turn) {
+    TurnClock::clock::time_point end = TurnClock::clock::now();
+    llama_perf_context_data perf = llama_perf_context((llama_context*)wrapper->ctx);
+
+    std::vector<double> m(METRIC_COUNT, 0.0);
+    m[METRIC_TTFT_MS] = elapsed_ms(turn.start, turn.has_first_token ? turn.first_token : end);
+    m[METRIC_PREFILL_MS] = elapsed_ms(turn.start, turn.prefill_end);
+    m[METRIC_PREFILL_TOKENS] = turn.n_prefill;
+    m[METRIC_PREFILL_TOKENS_PER_S] = tokens_per_second(turn.n_prefill, m[METRIC_PREFILL_MS]);
+    m[METRIC_DECODE_MS] = elapsed_ms(turn.prefill_end, end);
+    m[METRIC_DECODE_TOKENS] = turn.n_generated;
+    m[METRIC_DECODE_TOKENS_PER_S] = tokens_per_second(turn.n_generated, m[METRIC_DECODE_MS]);
+    m[METRIC_TOTAL_MS] = elapsed_ms(turn.start, end);
+    m[METRIC_KV_USED_CELLS] = llama_get_kv_cache_used_cells((llama_context*)wrapper->ctx);
+    m[METRIC_KV_CAPACITY] = wrapper->context_size;
+    m[METRIC_PEAK_RSS_KB] = peak_rss_kb();
+    m[METRIC_PERF_PROMPT_EVAL_MS] = perf.t_p_eval_ms;
+    m[METRIC_PERF_PROMPT_EVAL_TOKENS] = perf.n_p_eval;
+    m[METRIC_PERF_EVAL_MS] = perf.t_eval_ms;
+    m[METRIC_PERF_EVAL_TOKENS] = perf.n_eval;
+
+    std::lock_guard<std::mutex> lock(wrapper->metrics_mutex);
+    wrapper->last_metrics.swap(m);
+}
+
+// Receives each complete UTF-8 chunk as soon as it is sampled; return false to stop
+typedef std::function<bool(const char* piece, size_t len)> PieceCallback;
+
+// Optional hooks into one chat turn; unset members are skipped
+struct TurnCallbacks {
+    PieceCallback on_piece;       // every decoded piece
+    PieceCallback on_sentence;    // every finished sentence
+    ProgressCallback on_progress; // prefill progress, may cancel
+};
+
+// One chat turn: decode the new user text on top of the session and sample the reply
+static std::string run_chat_turn(LlamaModelWrapper* wrapper, const std::string& user_input,
+                                 const TurnCallbacks& callbacks) {
+    TRACE_SECTION("llama:chat_turn");
+    const PieceCallback& on_piece = callbacks.on_piece;
+    const PieceCallback& on_sentence = callbacks.on_sentence;
+
+    // Wait for any previous request; cancelGeneration makes that take at most one token
+    RequestLock lock(wrapper);
+    if (!ensure_context(wrapper)) {
+        return std::string("Disculpa, tuve un problema procesando tu mensaje. 😅");
+    }
+
+    auto start_time = std::chrono::high_resolution_clock::now();
+    TurnClock turn(wrapper);
+
+    try {
+        sync_thread_policy(wrapper);
+        LlamaSession& session = wrapper->session;
+
+        // Only the new turn is tokenized - everything before it already lives in the KV cache
+        std::vector<llama_token> tokens = tokenize_turn(wrapper, user_input);
+        int n_tokens = (int)tokens.size();
+
+        log_android(LOG_TAG, "🔤 Tokenized " + std::to_string(n_tokens) + " new tokens (" +
+                             std::to_string(session.tokens.size()) + " cached)");
+
+        // A partial prefill of this utterance is adopted as the start of the turn; session_sync
+        // keeps the part the final transcript agrees with
+        size_t turn_start = session.tokens.size();
+        if (wrapper->partial_start >= 0 &&
+            wrapper->partial_start + n_tokens + MAX_RESPONSE_TOKENS <= wrapper->context_size) {
+            turn_start = (size_t)wrapper->partial_start;
+            wrapper->partial_start = -1;
+        } else {
+            discard_partial_prefill(wrapper);
+            // Shift old turns out (prefix stays pinned) when the history would not leave room for a reply
+            session_make_room(wrapper, session, tokens, MAX_RESPONSE_TOKENS);
+            turn_start = session.tokens.size();
+        }
+
+        std::vector<llama_token> target(session.tokens.begin(), session.tokens.begin() + turn_start);
+        target.insert(target.end(), tokens.begin(), tokens.end());
+
+        // Evaluate the prompt
+        DecodeStatus status;
+        {
+            TRACE_SECTION("llama:prefill");
+            status = session_sync(wrapper, target, callbacks.on_progress);
+        }
+        TRACE_COUNTER("llama:kv_tokens", session.tokens.size());
+        if (status == DECODE_CANCELLED) {
+            // Not history: the chunks that made it stay only as a pending partial turn, which
+            // the next turn's session_sync reuses if it repeats the text and truncates otherwise
+            wrapper->partial_start = (int)turn_start;
+            log_android(LOG_TAG, "⏹️ Prefill cancelled after " + std::to_string(session.tokens.size()) + " tokens");
+            return std::string();
+        }
+        if (status != DECODE_OK) {
+            log_android(LOG_TAG, "❌ Failed to evaluate prompt");
+            session_reset(wrapper);
+            return std::string("Disculpa, tuve un problema procesando tu mensaje. 😅");
+        }
+        session.turn_starts.push_back(turn_start);
+        session.n_turns++;
+        turn.prefill_done(wrapper);
+
+        // Generate response
+        std::string response = "";
+        std::string pending;
+        SentenceSplitter splitter;
+        std::vector<std::string> sentences;
+        int n_sentences = 0;
+        bool stopped = false;
+        int max_tokens = MAX_RESPONSE_TOKENS; // Balanced for mobile performance
+
+        // Hand one reply token to the stream and speech consumers; false means stop now
+        auto emit_token = [&](llama_token token) -> bool {
+            turn.token_sampled();
+            TRACE_COUNTER("llama:tokens_generated", turn.n_generated);
+
+            // Convert token to string, holding back bytes of a split multi-byte character
+            size_t n_before = response.length();
+            append_token_piece(wrapper, token, response);
+            pending.append(response, n_before, std::string::npos);
+
+            size_t n_ready = utf8_complete_prefix(pending);
+            if (n_ready > 0 && on_piece && !on_piece(pending.data(), n_ready)) {
+                log_android(LOG_TAG, "⏹️ Stream consumer stopped generation");
+                return false;
+            }
+
+            // Hand finished sentences to the speech pipeline while decoding continues
+            splitter.feed(pending.data(), n_ready, sentences);
+            pending.erase(0, n_ready);
+            for (size_t s = 0; s < sentences.size() && !stopped; s++) {
+                n_sentences++;
+                if (on_sentence && !on_sentence(sentences[s].data(), sentences[s].size())) {
+                    log_android(LOG_TAG, "⏹️ Sentence consumer stopped generation");
+                    stopped = true;
+                }
+            }
+            sentences.clear();
+            return !stopped;
+        };
+
+        // With speculation, each step verifies `next_token` plus a draft in one batch; the
+        // main model's own sample at the first mismatch becomes the next step's token
+        std::vector<llama_token> draft;
+        std::vector<llama_token> history;
+        bool have_next = false;
+        llama_token next_token = 0;
+        int n_emitted = 0;
+
+        while (n_emitted < max_tokens) {
+            if (cancel_pending(wrapper)) {
+                log_android(LOG_TAG, "⏹️ Generation cancelled after " + std::to_string(n_emitted) + " tokens");
+                stopped = true;
+                break;
+            }
+
+            // Sample with Dream Assistant personality parameters
+            if (!have_next) {
+                next_token = sample_next_token(wrapper);
+            }
+            have_next = false;
+
+            // Check for end of sequence
+            if (is_end_of_turn(wrapper, next_token)) {
+                break;
+            }
+            n_emitted++;
+            if (!emit_token(next_token)) break;
+
+            draft.clear();
+            if (wrapper->spec_mode != SPEC_MODE_OFF && n_sentences < MAX_RESPONSE_SENTENCES) {
+                history.assign(session.tokens.begin(), session.tokens.end());
+                history.push_back(next_token);
+                int room = wrapper->context_size - (int)history.size();
+                propose_draft(wrapper, history, std::min(std::min(wrapper->spec_max_draft, max_tokens - n_emitted),
+                                                         std::min(room, wrapper->batch_capacity - 1)), draft);
+            }
+
+            // Evaluate the new token (and the draft riding along with it)
+            size_t n_before = session.tokens.size();
+            DecodeStatus token_status = draft.empty() ? session_decode(wrapper, &next_token, 1)
+                                                      : decode_with_draft(wrapper, session, next_token, draft);
+            if (token_status == DECODE_CANCELLED) {
+                log_android(LOG_TAG, "⏹️ Generation cancelled mid-decode");
+                stopped = true;
+                break;
+            }
+            if (token_status != DECODE_OK) {
+                log_android(LOG_TAG, "❌ Failed to evaluate token");
+                break;
+            }
+
+            // Keep spoken replies short: stop at a natural sentence boundary
+            if (n_sentences >= MAX_RESPONSE_SENTENCES) {
+                session_truncate(wrapper, session, n_before + 1);
+                break;
+            }
+            if (draft.empty()) continue;
+
+            // Accept draft tokens while the main model samples exactly the same thing
+            size_t n_accepted = 0;
+            bool finished = false;
+            while (true) {
+                history.assign(session.tokens.begin(), session.tokens.begin() + n_before + 1 + n_accepted);
+                llama_token sampled = sample_next_token(wrapper, (int)n_accepted, history);
+                if (n_accepted == draft.size() || sampled != draft[n_accepted]) {
+                    next_token = sampled;
+                    have_next = true;
+                    break;
+                }
+                n_accepted++;
+                n_emitted++;
+                if (!emit_token(sampled) || n_sentences >= MAX_RESPONSE_SENTENCES || n_emitted >= max_tokens) {
+                    finished = true;
+                    break;
+                }
+            }
+
+            wrapper->spec_stats.n_steps++;
+            wrapper->spec_stats.n_drafted += draft.size();
+            wrapper->spec_stats.n_accepted += n_accepted;
+            session_truncate(wrapper, session, n_before + 1 + n_accepted);
+            if (finished) break;
+        }
+
+        if (!stopped && on_sentence) {
+            splitter.flush(sentences);
+            for (size_t s = 0; s < sentences.size(); s++) {
+                if (!on_sentence(sentences[s].data(), sentences[s].size())) break;
+            }
+        }
+
+        auto end_time = std::chrono::high_resolution_clock::now();
+        auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end_time - start_time);
+        wrapper->last_inference_time = duration.count() / 1000.0f;
+        record_metrics(wrapper, turn);
+
+        // Clean up response
+        if (response.empty() && !cancel_pending(wrapper)) {
+            response = "¡Hola! Soy tu Dream Assistant. ¿En qué te puedo ayudar hoy? 😊";
+        }
+
+        log_android(LOG_TAG, "🤖 Dream Assistant response: " + response);
+        log_android(LOG_TAG, "⚡ Generation time: " + std::to_string(wrapper->last_inference_time) + "s");
+
+        return response;
+
+    } catch (const std::exception& e) {
+        log_android(LOG_TAG, "❌ Exception during generation: " + std::string(e.what()));
+        return "Ups, tuve un pequeño problema. ¡Pero estoy aquí para ti! 💪";
+    }
+}
+
+// Main session for id PREFIX_SEQ_ID, otherwise an open side session; nullptr if unknown
+static LlamaSession* find_session(LlamaModelWrapper* wrapper, int seq_id) {
+    if (seq_id == PREFIX_SEQ_ID) {
+        return &wrapper->session;
+    }
+    for (size_t i = 0; i < wrapper->parallel_sessions.size(); i++) {
+        LlamaSession& session = wrapper->parallel_sessions[i];
+        if (session.seq_id == seq_id && session.in_use) {
+            return &session;
+        }
+    }
+    return nullptr;
+}
+
+// Claim a free side sequence; its prefix cells are shared with seq 0, not recomputed
+// Caller holds ctx_mutex; returns nullptr when every side slot is taken
+static LlamaSession* claim_session(LlamaModelWrapper* wrapper) {
+    for (size_t i = 0; i < wrapper->parallel_sessions.size(); i++) {
+        LlamaSession& session = wrapper->parallel_sessions[i];
+        if (session.in_use) continue;
+
+        llama_kv_cache_seq_rm((llama_context*)wrapper->ctx, session.seq_id, -1, -1);
+        llama_kv_cache_seq_cp((llama_context*)wrapper->ctx, PREFIX_SEQ_ID, session.seq_id, 0, wrapper->n_prefix);
+        session.tokens.assign(wrapper->prefix_tokens.begin(), wrapper->prefix_tokens.begin() + wrapper->n_prefix);
+        session.turn_starts.clear();
+        session.n_turns = 0;
+        session.in_use = true;
+        return &session;
+    }
+    return nullptr;
+}
+
+// Caller holds ctx_mutex
+static void release_session(LlamaModelWrapper* wrapper, LlamaSession& session) {
+    if (wrapper->ctx != nullptr) {
+        llama_kv_cache_seq_rm((llama_context*)wrapper->ctx, session.seq_id, -1, -1);
+    }
+    session.tokens.clear();
+    session.turn_starts.clear();
+    session.n_turns = 0;
+    session.in_use = false;
+}
+
+static int open_session(LlamaModelWrapper* wrapper) {
+    RequestLock lock(wrapper);
+    if (!ensure_context(wrapper)) return -1;
+
+    LlamaSession* session = claim_session(wrapper);
+    return session != nullptr ? session->seq_id : -1;
+}
+
+static void close_session(LlamaModelWrapper* wrapper, int seq_id) {
+    RequestLock lock(wrapper);
+
+    LlamaSession* session = find_session(wrapper, seq_id);
+    if (session == nullptr || session == &wrapper->session) return;
+
+    release_session(wrapper, *session);
+}
+
+// Prefill each session's new turn, then decode one token for every session per shared
+// llama_decode. The last prompt token of each session joins the first step, so a short
+// prompt rides along with a long one. sessions[i] answers inputs[i]; nullptr entries are
+// skipped. Caller holds ctx_mutex. DECODE_CANCELLED if cancel or preemption cut it short.
+static DecodeStatus decode_turns_batched(LlamaModelWrapper* wrapper, const std::vector<LlamaSession*>& sessions,
+                                         const std::vector<std::string>& inputs, const std::vector<int>& max_tokens,
+                                         TurnClock& turn, std::vector<std::string>& responses) {
+    size_t n_seq = sessions.size();
+    DecodeStatus result = DECODE_OK;
+
+    std::vector<LlamaSession*> active;
+    std::vector<size_t> active_index;
+    std::vector<llama_token> next_tokens;
+    std::vector<int> limits(max_tokens);
+
+    // Every admitted turn and its replies come out of the same free cells. Evicting a
+    // session's own turns frees cells only it held, so its capacity stays fixed meanwhile.
+    int free_cells = kv_free_cells(wrapper);
+    for (size_t i = 0; i < n_seq; i++) {
+        LlamaSession* session = sessions[i];
+        if (session == nullptr) continue;
+
+        int capacity = std::min(wrapper->context_size, (int)session->tokens.size() + free_cells);
+        std::vector<llama_token> tokens = tokenize_turn(wrapper, *session, inputs[i]);
+        session_make_room(wrapper, *session, tokens, max_tokens[i], capacity);
+        int n_used = (int)(session->tokens.size() + tokens.size());
+        if (n_used >= capacity) {
+            log_android(LOG_TAG, "⚠️ No KV cells left for session " + std::to_string(session->seq_id));
+            continue;
+        }
+        limits[i] = std::min(max_tokens[i], capacity - n_used);
+        free_cells = capacity - n_used - limits[i];
+        size_t turn_start = session->tokens.size();
+
+        std::vector<llama_token> target(session->tokens);
+        target.insert(target.end(), tokens.begin(), tokens.end());
+
+        // Everything but the final prompt token; that one joins the shared first step
+        size_t n_keep = session_rewind(wrapper, *session, target);
+        DecodeStatus status = session_decode(wrapper, *session, target.data() + n_keep,
+                                             (int)(target.size() - n_keep - 1));
+        if (status != DECODE_OK) {
+            log_android(LOG_TAG, "❌ Failed to prefill session " + std::to_string(session->seq_id));
+            if (status == DECODE_FAILED) session_reset(wrapper, *session);
+            if (status == DECODE_CANCELLED) result = DECODE_CANCELLED;
+            continue;
+        }
+
+        session->turn_starts.push_back(turn_start);
+        session->n_turns++;
+        active.push_back(session);
+        active_index.push_back(i);
+        next_tokens.push_back(target.back());
+    }
+
+    turn.prefill_done(wrapper);
+
+    std::vector<int> n_generated(n_seq, 0);
+    while (!active.empty()) {
+        if (cancel_pending(wrapper)) {
+            result = DECODE_CANCELLED;
+            break;
+        }
+        DecodeStatus status = decode_parallel_step(wrapper, active, next_tokens);
+        if (status != DECODE_OK) {
+            log_android(LOG_TAG, "❌ Parallel decode step failed");
+            result = status;
+            break;
+        }
+
+        // Sample every sequence from its row of the shared batch, then drop finished ones
+        std::vector<LlamaSession*> still_active;
+        std::vector<size_t> still_index;
+        std::vector<llama_token> still_tokens;
+        for (size_t a = 0; a < active.size(); a++) {
+            size_t i = active_index[a];
+            llama_token token = sample_next_token(wrapper, (int)a, active[a]->tokens);
+
+            if (is_end_of_turn(wrapper, token) || ++n_generated[i] > limits[i]) {
+                continue;
+            }
+            append_token_piece(wrapper, token, responses[i]);
+            turn.token_sampled();
+            TRACE_COUNTER("llama:tokens_generated", turn.n_generated);
+
+            still_active.push_back(active[a]);
+            still_index.push_back(i);
+            still_tokens.push_back(token);
+        }
+        active.swap(still_active);
+        active_index.swap(still_index);
+        next_tokens.swap(still_tokens);
+    }
+    return result;
+}
+
+// One turn on several sessions at once, see decode_turns_batched
+static std::vector<std::string> run_parallel_turns(LlamaModelWrapper* wrapper, const std::vector<int>& seq_ids,
+                                                   const std::vector<std::string>& inputs,
+                                                   const std::vector<int>& max_tokens) {
+    TRACE_SECTION("llama:parallel_turns");
+    RequestLock lock(wrapper);
+    if (!ensure_context(wrapper)) {
+        return std::vector<std::string>(seq_ids.size());
+    }
+    discard_partial_prefill(wrapper);
+
+    auto start_time = std::chrono::high_resolution_clock::now();
+    TurnClock turn(wrapper);
+    size_t n_seq = seq_ids.size();
+    std::vector<std::string> responses(n_seq);
+
+    sync_thread_policy(wrapper);
+
+    std::vector<LlamaSession*> sessions(n_seq, nullptr);
+    for (size_t i = 0; i < n_seq; i++) {
+        LlamaSession* session = find_session(wrapper, seq_ids[i]);
+        if (session == nullptr || std::find(sessions.begin(), sessions.end(), session) != sessions.end()) {
+            log_android(LOG_TAG, "⚠️ Skipping unknown or repeated session " + std::to_string(seq_ids[i]));
+            continue;
+        }
+        sessions[i] = session;
+    }
+
+    decode_turns_batched(wrapper, sessions, inputs, max_tokens, turn, responses);
+
+    auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::high_resolution_clock::now() - start_time);
+    wrapper->last_inference_time = duration.count() / 1000.0f;
+    record_metrics(wrapper, turn);
+    log_android(LOG_TAG, "⚡ Parallel generation of " + std::to_string(n_seq) + " sessions: " +
+                         std::to_string(wrapper->last_inference_time) + "s");
+
+    return responses;
+}
+
+// Offline submitBatch work: prompts are answered in waves of side sessions, prefix cells
+// shared with seq 0, and the replies written to a suggestion cache file at the end
+struct BatchJob {
+    std::vector<std::string> keys;
+    std::vector<std::string> prompts;
+    int max_tokens;
+    std::string cache_path;
+    std::vector<std::string> replies; // replies[i] answers prompts[i], i < replies.size()
+
+    BatchJob() : max_tokens(MAX_RESPONSE_TOKENS) {}
+};
+
+// Answer the next prompts of `job` on as many side sessions as are free and whose turns fit
+// in the KV cells the conversation leaves over; a prompt too big for them on its own gets
+// an empty reply. The main session is not touched. A wave cut
+// short is dropped whole (its sessions are released), so it can simply run again.
+// Caller holds ctx_mutex.
+static DecodeStatus run_batch_wave(LlamaModelWrapper* wrapper, BatchJob& job) {
+    TRACE_SECTION("llama:batch_wave");
+    int free_cells = kv_free_cells(wrapper);
+
+    std::vector<LlamaSession*> sessions;
+    std::vector<std::string> inputs;
+    std::vector<int> limits;
+    size_t next = job.replies.size();
+    while (next + sessions.size() < job.prompts.size()) {
+        const std::string& prompt = job.prompts[next + sessions.size()];
+        LlamaSession fresh;
+        int cost = (int)tokenize_turn(wrapper, fresh, wrapper->n_prefix, prompt).size() + job.max_tokens;
+        if (cost > free_cells) {
+            if (!sessions.empty()) break;
+            // Would not fit even alone, so waiting cannot help: answer it empty and move on
+            log_android(LOG_TAG, "⚠️ Batch prompt " + std::to_string(next) + " needs " + std::to_string(cost) +
+                                 " KV cells, " + std::to_string(free_cells) + " free; skipped");
+            job.replies.push_back(std::string());
+            next++;
+            continue;
+        }
+
+        LlamaSession* session = claim_session(wrapper);
+        if (session == nullptr) break;
+        sessions.push_back(session);
+        inputs.push_back(prompt);
+        limits.push_back(job.max_tokens);
+        free_cells -= cost;
+    }
+    if (sessions.empty()) {
+        if (next == job.prompts.size()) return DECODE_OK;
+        log_android(LOG_TAG, "❌ No free side session for batch generation");
+        return DECODE_FAILED;
+    }
+
+    TurnClock turn(wrapper);
+    std::vector<std::string> replies(sessions.size());
+    DecodeStatus status = decode_turns_batched(wrapper, sessions, inputs, limits, turn, replies);
+    for (size_t i = 0; i < sessions.size(); i++) {
+        release_session(wrapper, *sessions[i]);
+    }
+    if (status != DECODE_OK) return status;
+
+    job.replies.insert(job.replies.end(), replies.begin(), replies.end());
+    double ms = elapsed_ms(turn.start, TurnClock::clock::now());
+    log_android(LOG_TAG, "📦 Batch wave: " + std::to_string(sessions.size()) + " prompts, " +
+                         std::to_string(turn.n_generated) + " tokens in " + std::to_string((int)ms) + " ms (" +
+                         std::to_string(job.replies.size()) + "/" + std::to_string(job.prompts.size()) + ")");
+    return DECODE_OK;
+}
+
+// Suggestion cache written by submitBatch and read by SuggestionCache.kt without loading the
+// model: this header, then per entry the key and the reply, each a uint32 byte length and
+// UTF-8 bytes. Little endian throughout.
+struct SuggestionCacheHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t n_entries;
+    uint32_t adapter_id; // lora_state_id of the weights the replies came from
+    int64_t created_at;  // unix seconds
+};
+
+static void write_length_prefixed(FILE* file, const std::string& bytes) {
+    uint32_t length = (uint32_t)bytes.size();
+    fwrite(&length, sizeof(length), 1, file);
+    fwrite(bytes.data(), 1, bytes.size(), file);
+}
+
+// Written next to the target and renamed over it, so readers never see a partial file
+static bool write_suggestion_cache(LlamaModelWrapper* wrapper, const BatchJob& job) {
+    std::string tmp_path = job.cache_path + ".tmp";
+    FILE* file = fopen(tmp_path.c_str(), "wb");
+    if (file == nullptr) {
+        log_android(LOG_TAG, "❌ Cannot write suggestion cache " + tmp_path);
+        return false;
+    }
+
+    SuggestionCacheHeader header;
+    header.magic = SUGGESTION_CACHE_MAGIC;
+    header.version = SUGGESTION_CACHE_VERSION;
+    header.n_entries = (uint32_t)job.replies.size();
+    header.adapter_id = lora_state_id(wrapper);
+    header.created_at = (int64_t)time(nullptr);
+    fwrite(&header, sizeof(header), 1, file);
+    for (size_t i = 0; i < job.replies.size(); i++) {
+        write_length_prefixed(file, job.keys[i]);
+        write_length_prefixed(file, job.replies[i]);
+    }
+
+    bool ok = fflush(file) == 0 && !ferror(file);
+    ok = fclose(file) == 0 && ok;
+    if (!ok || rename(tmp_path.c_str(), job.cache_path.c_str()) != 0) {
+        unlink(tmp_path.c_str());
+        log_android(LOG_TAG, "❌ Failed to write suggestion cache " + job.cache_path);
+        return false;
+    }
+    log_android(LOG_TAG, "💾 Suggestion cache: " + std::to_string(job.replies.size()) + " entries in " + job.cache_path);
+    return true;
+}
+
+// Queue job body: waves until every prompt is answered, yielding to more urgent requests
+// between and during waves. False = yielded; progress stays in `job`.
+static bool run_batch_job(LlamaModelWrapper* wrapper, BatchJob& job, bool& written) {
+    TRACE_SECTION("llama:batch");
+    RequestLock lock(wrapper);
+    written = false;
+    if (wrapper->shutting_down.load() || !ensure_context(wrapper)) return true;
+    sync_thread_policy(wrapper);
+
+    while (job.replies.size() < job.prompts.size()) {
+        if (wrapper->queue.preempt_requested()) return false;
+
+        DecodeStatus status = run_batch_wave(wrapper, job);
+        if (status == DECODE_CANCELLED && !cancel_pending(wrapper) && !wrapper->shutting_down.load() &&
+            wrapper->queue.preempt_requested()) {
+            log_android(LOG_TAG, "⏸️ Batch yielding to a more urgent request");
+            return false;
+        }
+        if (status != DECODE_OK) return true;
+    }
+
+    written = write_suggestion_cache(wrapper, job);
+    return true;
+}
+
+// Structured assistant actions; the WhatsApp/calendar code parses exactly this shape
+static const char* ACTION_GRAMMAR =
+        "root   ::= \"{\" ws \"\\\"action\\\":\" ws action \",\" ws \"\\\"contact\\\":\" ws string \",\" ws \"\\\"text\\\":\" ws string ws \"}\"\n"
+        "action ::= \"\\\"send_message\\\"\" | \"\\\"call\\\"\" | \"\\\"create_event\\\"\" | \"\\\"set_reminder\\\"\" | \"\\\"none\\\"\"\n"
+        "string ::= \"\\\"\" char* \"\\\"\"\n"
+        "char   ::= [^\"\\\\\\x00-\\x1F] | \"\\\\\" [\"\\\\/nt]\n"
+        "ws     ::= \" \"?\n";
+
+static const char* ACTION_INSTRUCTION =
+        "Convierte la petición en una acción JSON {action, contact, text}: ";
+
+// (Re)build the grammar sampler when the grammar text changes; masks belong to one grammar
+static bool prepare_grammar(LlamaModelWrapper* wrapper, const std::string& grammar_text) {
+    if (wrapper->grammar != nullptr && wrapper->grammar_text == grammar_text) {
+        llama_sampler_reset(wrapper->grammar);
+        return true;
+    }
+
+    if (wrapper->grammar != nullptr) {
+        llama_sampler_free(wrapper->grammar);
+    }
+    wrapper->grammar = llama_sampler_init_grammar((llama_model*)wrapper->model, grammar_text.c_str(), "root");
+    wrapper->grammar_text = wrapper->grammar != nullptr ? grammar_text : std::string();
+    wrapper->grammar_masks.clear();
+    return wrapper->grammar != nullptr;
+}
+
+static bool grammar_allows(llama_sampler* grammar, llama_token token) {
+    llama_token_data single = { token, 0.0f, 0.0f };
+    llama_token_data_array array = { &single, 1, -1, false };
+    llama_sampler_apply(grammar, &array);
+    return array.data[0].logit != -INFINITY;
+}
+
+// Raw logits of row `logits_index` into candidates[0..n_vocab)
+static void load_candidates(LlamaModelWrapper* wrapper, int logits_index) {
+    const float* logits = llama_get_logits_ith((llama_context*)wrapper->ctx, logits_index);
+    llama_token_data* candidates = wrapper->candidates.data();
+    for (int i = 0; i < wrapper->vocab_size; i++) {
+        candidates[i].id = i;
+        candidates[i].logit = logits[i];
+        candidates[i].p = 0.0f;
+    }
+}
+
+static llama_token sample_from(LlamaModelWrapper* wrapper, size_t n_candidates) {
+    llama_token_data_array array = { wrapper->candidates.data(), n_candidates, -1, false };
+    llama_sampler_apply(wrapper->sampler, &array);
+    return array.data[array.selected].id;
+}
+
+// Grammar-constrained sample without scanning the vocab on every token:
+//  1. the allowed set for this exact text was seen before -> sample among those tokens only
+//  2. otherwise sample freely and check just that one token against the grammar
+//  3. only if it is rejected, mask the whole vocab once and cache the set when it is small
+static llama_token sample_constrained(LlamaModelWrapper* wrapper, const std::string& text) {
+    llama_token_data* candidates = wrapper->candidates.data();
+    const float* logits = llama_get_logits_ith((llama_context*)wrapper->ctx, -1);
+    llama_token token;
+
+    auto cached = wrapper->grammar_masks.find(text);
+    if (cached != wrapper->grammar_masks.end()) {
+        const std::vector<llama_token>& allowed = cached->second;
+        for (size_t i = 0; i < allowed.size(); i++) {
+            candidates[i].id = allowed[i];
+            candidates[i].logit = logits[allowed[i]];
+            candidates[i].p = 0.0f;
+        }
+        token = sample_from(wrapper, allowed.size());
+    } else {
+        load_candidates(wrapper, -1);
+        token = sample_from(wrapper, (size_t)wrapper->vocab_size);
+
+        if (!grammar_allows(wrapper->grammar, token)) {
+            TRACE_SECTION("llama:grammar_mask");
+            load_candidates(wrapper, -1);
+            llama_token_data_array array = { candidates, (size_t)wrapper->vocab_size, -1, false };
+            llama_sampler_apply(wrapper->grammar, &array);
+
+            size_t n_allowed = 0;
+            for (size_t i = 0; i < array.size; i++) {
+                if (array.data[i].logit != -INFINITY) candidates[n_allowed++] = array.data[i];
+            }
+            if (n_allowed == 0) {
+                return llama_token_eos((llama_model*)wrapper->model);
+            }
+
+            if (n_allowed <= GRAMMAR_MASK_MAX_TOKENS) {
+                if (wrapper->grammar_masks.size() >= GRAMMAR_MASK_CACHE_ENTRIES) {
+                    wrapper->grammar_masks.clear();
+                }
+                std::vector<llama_token>& allowed = wrapper->grammar_masks[text];
+                for (size_t i = 0; i < n_allowed; i++) allowed.push_back(candidates[i].id);
+            }
+            token = sample_from(wrapper, n_allowed);
+        }
+    }
+
+    llama_sampler_accept(wrapper->sampler, token);
+    llama_sampler_accept(wrapper->grammar, token);
+    return token;
+}
+
+// One constrained request on a scratch side session, so the chat history is untouched
+static std::string run_action_turn(LlamaModelWrapper* wrapper, const std::string& user_input,
+                                   const std::string& grammar_text) {
+    TRACE_SECTION("llama:action_turn");
+    RequestLock lock(wrapper);
+    if (!ensure_context(wrapper)) {
+        return std::string();
+    }
+    sync_thread_policy(wrapper);
+
+    TurnClock turn(wrapper);
+    std::string json;
+
+    if (!prepare_grammar(wrapper, grammar_text)) {
+        log_android(LOG_TAG, "❌ Invalid action grammar");
+        return json;
+    }
+    LlamaSession* session = claim_session(wrapper);
+    if (session == nullptr) {
+        log_android(LOG_TAG, "⚠️ No free session for action decoding");
+        return json;
+    }
+
+    // The side session grows into the cells the conversation leaves free, not the whole context
+    int capacity = std::min(wrapper->context_size, (int)session->tokens.size() + kv_free_cells(wrapper));
+    std::vector<llama_token> tokens = tokenize_turn(wrapper, *session, ACTION_INSTRUCTION + user_input);
+    session_make_room(wrapper, *session, tokens, ACTION_MAX_TOKENS, capacity);
+    int n_used = (int)(session->tokens.size() + tokens.size());
+    if (n_used >= capacity) {
+        log_android(LOG_TAG, "⚠️ No KV cells left for action decoding");
+        release_session(wrapper, *session);
+        return json;
+    }
+    int max_tokens = std::min(ACTION_MAX_TOKENS, capacity - n_used);
+    DecodeStatus status = session_decode(wrapper, *session, tokens.data(), (int)tokens.size());
+    turn.prefill_done(wrapper);
+
+    for (int i = 0; status == DECODE_OK && i < max_tokens && !cancel_pending(wrapper); i++) {
+        llama_token token = sample_constrained(wrapper, json);
+        if (is_end_of_turn(wrapper, token)) {
+            break;
+        }
+        turn.token_sampled();
+        append_token_piece(wrapper, token, json);
+        status = session_decode(wrapper, *session, &token, 1);
+    }
+
+    release_session(wrapper, *session);
+    record_metrics(wrapper, turn);
+    log_android(LOG_TAG, "🧩 Action: " + json + " (" + std::to_string(wrapper->grammar_masks.size()) +
+                         " cached grammar masks)");
+    return json;
+}
+
+// Mean-pooled, unit-length embedding of `text` from a prefill-only pass on a side session.
+// The context keeps the model's own pooling (none for Gemma), so every row is read back
+// and averaged here; the cached system prompt is shared, only the text itself is decoded.
+// Caller holds ctx_mutex.
+static bool embed_text(LlamaModelWrapper* wrapper, const std::string& text, std::vector<float>& out) {
+    TRACE_SECTION("llama:embed");
+    llama_context* ctx = (llama_context*)wrapper->ctx;
+
+    std::vector<llama_token> tokens = tokenize_text(wrapper, text, false);
+    if (tokens.empty()) return false;
+    if ((int)tokens.size() > wrapper->batch_capacity) {
+        tokens.resize(wrapper->batch_capacity);
+    }
+
+    LlamaSession* session = claim_session(wrapper);
+    if (session == nullptr) {
+        log_android(LOG_TAG, "⚠️ No free session for embedding");
+        return false;
+    }
+
+    llama_batch& batch = wrapper->batch;
+    llama_pos pos = (llama_pos)session->tokens.size();
+    int n = (int)tokens.size();
+
+    batch.n_tokens = n;
+    for (int i = 0; i < n; i++) {
+        batch.token[i] = tokens[i];
+        batch.pos[i] = pos + i;
+        batch.n_seq_id[i] = 1;
+        batch.seq_id[i][0] = session->seq_id;
+        batch.logits[i] = true;
+    }
+
+    llama_set_embeddings(ctx, true);
+    bool ok = llama_decode(ctx, batch) == 0;
+    if (ok) {
+        int dim = llama_n_embd((llama_model*)wrapper->model);
+        out.assign(dim, 0.0f);
+        for (int i = 0; i < n && ok; i++) {
+            const float* row = llama_get_embeddings_ith(ctx, i);
+            if (row == nullptr) {
+                ok = false;
+                break;
+            }
+            for (int d = 0; d < dim; d++) out[d] += row[d];
+        }
+
+        double norm = 0.0;
+        for (int d = 0; d < dim; d++) norm += (double)out[d] * out[d];
+        if (ok && norm > 0.0) {
+            float scale = (float)(1.0 / std::sqrt(norm));
+            for (int d = 0; d < dim; d++) out[d] *= scale;
+        } else {
+            ok = false;
+        }
+    }
+    llama_set_embeddings(ctx, false);
+
+    wrapper->n_evaluated += n;
+    release_session(wrapper, *session);
+    return ok;
+}
+
+static float dot_product(const float* a, const float* b, int n) {
+    int i = 0;
+    float sum = 0.0f;
+#if defined(__aarch64__)
+    float32x4_t acc0 = vdupq_n_f32(0.0f);
+    float32x4_t acc1 = vdupq_n_f32(0.0f);
+    for (; i + 8 <= n; i += 8) {
+        acc0 = vfmaq_f32(acc0, vld1q_f32(a + i), vld1q_f32(b + i));
+        acc1 = vfmaq_f32(acc1, vld1q_f32(a + i + 4), vld1q_f32(b + i + 4));
+    }
+    sum = vaddvq_f32(vaddq_f32(acc0, acc1));
+#else
+    // Four independent sums so the adds pipeline; the compiler cannot reorder a single float chain
+    float s0 = 0.0f, s1 = 0.0f, s2 = 0.0f, s3 = 0.0f;
+    for (; i + 4 <= n; i += 4) {
+        s0 += a[i] * b[i];
+        s1 += a[i + 1] * b[i + 1];
+        s2 += a[i + 2] * b[i + 2];
+        s3 += a[i + 3] * b[i + 3];
+    }
+    sum = (s0 + s1) + (s2 + s3);
+#endif
+    for (; i < n; i++) sum += a[i] * b[i];
+    return sum;
+}
+
+// Best exemplar by cosine similarity; returns its index, or -1 for an empty index
+static int intent_nearest(const IntentIndex& index, const std::vector<float>& query, float& best_score) {
+    int best = -1;
+    best_score = -1.0f;
+    for (size_t i = 0; i < index.size(); i++) {
+        float score = dot_product(index.vectors.data() + i * index.dim, query.data(), index.dim);
+        if (score > best_score) {
+            best_score = score;
+            best = (int)i;
+        }
+    }
+    return best;
+}
+
+// DECODE_CANCELLED when a cancel or a more urgent request cut the embedding short
+static DecodeStatus add_intent_exemplar(LlamaModelWrapper* wrapper, const std::string& label,
+                                        const std::string& text) {
+    RequestLock lock(wrapper);
+    if (!ensure_context(wrapper)) return DECODE_FAILED;
+    IntentIndex& index = wrapper->intents;
+    if (index.size() >= INTENT_MAX_EXEMPLARS) {
+        log_android(LOG_TAG, "⚠️ Intent index full, ignoring '" + label + "'");
+        return DECODE_FAILED;
+    }
+
+    std::vector<float> embedding;
+    if (!embed_text(wrapper, text, embedding)) {
+        bool aborted = cancel_pending(wrapper) || wrapper->queue.preempt_requested();
+        return aborted ? DECODE_CANCELLED : DECODE_FAILED;
+    }
+
+    index.dim = (int)embedding.size();
+    index.vectors.insert(index.vectors.end(), embedding.begin(), embedding.end());
+    index.labels.push_back(label);
+    return DECODE_OK;
+}
+
+// Label of the closest exemplar if it clears min_score, otherwise "" (fall through to generation)
+static std::string match_intent(LlamaModelWrapper* wrapper, const std::string& text, float min_score) {
+    RequestLock lock(wrapper);
+    if (wrapper->intents.size() == 0 || !ensure_context(wrapper)) return std::string();
+
+    TurnClock turn(wrapper);
+    std::vector<float> embedding;
+    if (!embed_text(wrapper, text, embedding)) return std::string();
+    turn.prefill_done(wrapper);
+
+    float score = 0.0f;
+    int best = intent_nearest(wrapper->intents, embedding, score);
+    record_metrics(wrapper, turn);
+
+    char line[96];
+    snprintf(line, sizeof(line), " (%.3f, %.1f ms)", score, elapsed_ms(turn.start, TurnClock::clock::now()));
+    if (best < 0 || score < min_score) {
+        log_android(LOG_TAG, std::string("🎯 No confident intent") + line);
+        return std::string();
+    }
+    log_android(LOG_TAG, "🎯 Intent " + wrapper->intents.labels[best] + line);
+    return wrapper->intents.labels[best];
+}
+
+// Wrap a Kotlin `fun <method>(utf8: ByteArray): Boolean` as a PieceCallback.
+// Only valid on the calling thread, for the duration of the JNI call.
+static PieceCallback make_byte_array_callback(JNIEnv* env, jobject callback, const char* method) {
+    if (callback == nullptr) return PieceCallback();
+
+    jclass callback_class = env->GetObjectClass(callback);
+    jmethodID method_id = env->GetMethodID(callback_class, method, "([B)Z");
+    env->DeleteLocalRef(callback_class);
+    if (method_id == nullptr) {
+        env->ExceptionClear();
+        log_android(LOG_TAG, std::string("⚠️ Callback has no ") + method + "([B)Z");
+        return PieceCallback();
+    }
+
+    return [env, callback, method_id](const char* piece, size_t len) -> bool {
+        TRACE_SECTION("jni:callback");
+        jbyteArray bytes = env->NewByteArray((jsize)len);
+        if (bytes == nullptr) return false;
+        env->SetByteArrayRegion(bytes, 0, (jsize)len, reinterpret_cast<const jbyte*>(piece));
+        jboolean keep_going = env->CallBooleanMethod(callback, method_id, bytes);
+        env->DeleteLocalRef(bytes);
+        if (env->ExceptionCheck()) {
+            env->ExceptionClear();
+            return false;
+        }
+        return keep_going == JNI_TRUE;
+    };
+}
+
+// Stream pieces through a caller-owned direct ByteBuffer: each piece is written at
+// offset 0 and announced with `fun onBytes(length: Int): Boolean`, so no Java
+// objects are created per token
+static PieceCallback make_direct_buffer_callback(JNIEnv* env, jobject callback, char* out, size_t capacity) {
+    if (callback == nullptr || out == nullptr) return PieceCallback();
+
+    jclass callback_class = env->GetObjectClass(callback);
+    jmethodID method_id = env->GetMethodID(callback_class, "onBytes", "(I)Z");
+    env->DeleteLocalRef(callback_class);
+    if (method_id == nullptr) {
+        env->ExceptionClear();
+        log_android(LOG_TAG, "⚠️ Callback has no onBytes(I)Z");
+        return PieceCallback();
+    }
+
+    return [env, callback, method_id, out, capacity](const char* piece, size_t len) -> bool {
+        TRACE_SECTION("jni:callback");
+        // Pieces are a few bytes; a buffer smaller than one piece is a caller bug
+        if (len > capacity) return false;
+        memcpy(out, piece, len);
+        jboolean keep_going = env->CallBooleanMethod(callback, method_id, (jint)len);
+        if (env->ExceptionCheck()) {
+            env->ExceptionClear();
+            return false;
+        }
+        return keep_going == JNI_TRUE;
+    };
+}
+
+// Wrap an optional Kotlin `fun onPrefillProgress(done: Int, total: Int): Boolean`
+static ProgressCallback make_progress_callback(JNIEnv* env, jobject callback) {
+    if (callback == nullptr) return ProgressCallback();
+
+    jclass callback_class = env->GetObjectClass(callback);
+    jmethodID method_id = env->GetMethodID(callback_class, "onPrefillProgress", "(II)Z");
+    env->DeleteLocalRef(callback_class);
+    if (method_id == nullptr) {
+        env->ExceptionClear();
+        return ProgressCallback();
+    }
+
+    return [env, callback, method_id](int n_done, int n_total) -> bool {
+        jboolean keep_going = env->CallBooleanMethod(callback, method_id, (jint)n_done, (jint)n_total);
+        if (env->ExceptionCheck()) {
+            env->ExceptionClear();
+            return false;
+        }
+        return keep_going == JNI_TRUE;
+    };
+}
+
+// ggml abort callback: lets cancelGeneration interrupt a decode between graph nodes, and an
+// interactive request on the worker queue interrupt a background job the same way
+static bool abort_requested(void* data) {
+    auto* wrapper = reinterpret_cast<LlamaModelWrapper*>(data);
+    return cancel_pending(wrapper) || wrapper->shutting_down.load() || wrapper->queue.preempt_requested();
+}
+
+// Start readahead of the whole GGUF through a private mapping. The page cache is
+// shared with llama's own mmap, so its first real touches become minor faults.
+static void advise_model_pages(const std::string& path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) return;
+
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        void* addr = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (addr != MAP_FAILED) {
+            madvise(addr, st.st_size, MADV_WILLNEED);
+            munmap(addr, st.st_size);
+        }
+    }
+    close(fd);
+}
+
+// Decode a throwaway batch so compute buffers get allocated and weights faulted in. It runs
+// on a scratch side sequence, so a conversation that started before warm-up is not touched.
+static bool warmup_decode(LlamaModelWrapper* wrapper) {
+    LlamaSession* scratch = claim_session(wrapper);
+    if (scratch == nullptr) return false;
+
+    std::vector<llama_token> dummy(WARMUP_BATCH_TOKENS, llama_token_bos((llama_model*)wrapper->model));
+    bool ok = session_decode(wrapper, *scratch, dummy.data(), (int)dummy.size()) == DECODE_OK;
+    release_session(wrapper, *scratch);
+    return ok;
+}
+
+// Caching the prefix rebuilds the whole KV cache, so it only happens before any request
+static bool prefix_cache_pending(const LlamaModelWrapper* wrapper) {
+    if (wrapper->n_prefix > 0 || !wrapper->session.tokens.empty() || wrapper->session.n_turns > 0) {
+        return false;
+    }
+    for (size_t i = 0; i < wrapper->parallel_sessions.size(); i++) {
+        if (wrapper->parallel_sessions[i].in_use) return false;
+    }
+    return true;
+}
+
+// Background queue job. Each stage is skipped once readiness says it is done, so after
+// yielding to an interactive request the job resumes where it left off; false = yielded.
+static bool run_warmup(LlamaModelWrapper* wrapper) {
+    TRACE_SECTION("llama:warmup");
+    RequestLock lock(wrapper);
+    if (wrapper->shutting_down.load() || !ensure_context(wrapper)) return true;
+    auto start_time = std::chrono::high_resolution_clock::now();
+
+    if (wrapper->readiness.load() < READINESS_WARMED) {
+        advise_model_pages(wrapper->model_path);
+        if (warmup_decode(wrapper)) {
+            wrapper->readiness.store(READINESS_WARMED);
+            log_android(LOG_TAG, "🔥 Model warmed up");
+        } else if (wrapper->queue.preempt_requested()) {
+            log_android(LOG_TAG, "⏸️ Warm-up yielding to an interactive request");
+            return false;
+        }
+    }
+    if (wrapper->shutting_down.load()) return true;
+
+    if (wrapper->readiness.load() < READINESS_PREFIX_CACHED && prefix_cache_pending(wrapper)) {
+        if (prepare_prefix_cache(wrapper)) {
+            wrapper->readiness.store(READINESS_PREFIX_CACHED);
+            log_android(LOG_TAG, "📌 System prefix cached: " + std::to_string(wrapper->n_prefix) + " tokens");
+        } else if (wrapper->queue.preempt_requested()) {
+            log_android(LOG_TAG, "⏸️ Warm-up yielding to an interactive request");
+            return false;
+        }
+    } else if (wrapper->n_prefix > 0) {
+        wrapper->readiness.store(READINESS_PREFIX_CACHED);
+    }
+
+    auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::high_resolution_clock::now() - start_time);
+    log_android(LOG_TAG, "⏱️ Warm-up finished in " + std::to_string(duration.count()) + "ms");
+    return true;
+}
+
+// JNIEnv of the queue worker, attached to the VM for as long as the worker runs
+static thread_local JNIEnv* t_worker_env = nullptr;
+
+static void start_worker(JNIEnv* env, LlamaModelWrapper* wrapper) {
+    JavaVM* vm = nullptr;
+    if (env->GetJavaVM(&vm) != JNI_OK || vm == nullptr) return;
+
+    wrapper->queue.start(
+            [vm]() {
+                if (vm->AttachCurrentThread(&t_worker_env, nullptr) != JNI_OK) {
+                    t_worker_env = nullptr;
+                    log_android(LOG_TAG, "⚠️ Inference worker could not attach to the VM");
+                }
+            },
+            [vm]() {
+                if (t_worker_env != nullptr) vm->DetachCurrentThread();
+                t_worker_env = nullptr;
+            });
+}
+
+// Process-wide ggml/llama state: initialised by the first model, torn down after the last one
+static std::mutex g_backend_mutex;
+static int g_backend_refs = 0;
+static std::unordered_map<std::string, SharedModel*> g_models;
+static KvCacheConfig g_kv_config;
+
+static bool acquire_backend() {
+    if (g_backend_refs == 0) {
+        llama_backend_init();
+        llama_numa_init(GGML_NUMA_STRATEGY_DISABLED);
+
+        // Pick the fastest ggml CPU kernels this phone supports before any tensor work
+        if (!load_cpu_backend()) {
+            llama_backend_free();
+            return false;
+        }
+        log_android(LOG_TAG, "⚙️ llama backend initialized");
+    }
+    g_backend_refs++;
+    return true;
+}
+
+static void release_backend() {
+    if (--g_backend_refs == 0) {
+        llama_backend_free();
+        log_android(LOG_TAG, "⚙️ llama backend released");
+    }
+}
+
+// Return the already-loaded model for this path or load it; the caller owns one reference
+static SharedModel* acquire_model(const std::string& path) {
+    TRACE_SECTION("llama:load_model");
+    std::lock_guard<std::mutex> lock(g_backend_mutex);
+
+    auto it = g_models.find(path);
+    if (it != g_models.end()) {
+        it->second->refs++;
+        log_android(LOG_TAG, "♻️ Reusing loaded model (" + std::to_string(it->second->refs) + " refs)");
+        return it->second;
+    }
+
+    if (!acquire_backend()) {
+        return nullptr;
+    }
+
+    // Model parameters optimized for sister's use case
+    llama_model_params model_params = llama_model_default_params();
+    model_params.n_gpu_layers = 0; // CPU only for Android
+    model_params.use_mmap = true;
+    model_params.use_mlock = false;
+
+    llama_model* model = llama_load_model_from_file(path.c_str(), model_params);
+    if (model == nullptr) {
+        log_android(LOG_TAG, "❌ Failed to load model");
+        release_backend();
+        return nullptr;
+    }
+
+    auto* shared = new SharedModel();
+    shared->model = model;
+    shared->path = path;
+    shared->refs = 1;
+    g_models[path] = shared;
+    return shared;
+}
+
+static void release_model(SharedModel* shared) {
+    std::lock_guard<std::mutex> lock(g_backend_mutex);
+
+    if (--shared->refs > 0) {
+        return;
+    }
+
+    g_models.erase(shared->path);
+    for (std::unordered_map<std::string, LoraAdapterRef>::iterator it = shared->adapters.begin();
+         it != shared->adapters.end(); ++it) {
+        llama_lora_adapter_free(it->second.adapter);
+    }
+    llama_free_model(shared->model);
+    delete shared;
+    release_backend();
+}
+
+static ggml_type kv_cache_ggml_type(int kv_type) {
+    switch (kv_type) {
+        case KV_CACHE_Q8_0: return GGML_TYPE_Q8_0;
+        case KV_CACHE_Q4_0: return GGML_TYPE_Q4_0;
+        default:            return GGML_TYPE_F16;
+    }
+}
+
+// Integer GGUF metadata under the model's architecture prefix, e.g. "gemma2.attention.head_count"
+static int model_meta_int(const llama_model* model, const std::string& arch, const char* key, int fallback) {
+    char buf[64];
+    std::string full_key = arch + "." + key;
+    if (llama_model_meta_val_str(model, full_key.c_str(), buf, sizeof(buf)) <= 0) {
+        return fallback;
+    }
+    return atoi(buf);
+}
+
+static KvLayout read_kv_layout(const llama_model* model) {
+    char arch[64] = "llama";
+    llama_model_meta_val_str(model, "general.architecture", arch, sizeof(arch));
+
+    KvLayout layout;
+    layout.n_layer = llama_n_layer(model);
+    layout.n_head_kv = model_meta_int(model, arch, "attention.head_count_kv",
+                                      model_meta_int(model, arch, "attention.head_count", 1));
+    int head_dim = llama_n_embd(model) / std::max(1, model_meta_int(model, arch, "attention.head_count", 1));
+    layout.key_length = model_meta_int(model, arch, "attention.key_length", head_dim);
+    layout.value_length = model_meta_int(model, arch, "attention.value_length", head_dim);
+    layout.n_ctx_train = llama_n_ctx_train(model);
+    return layout;
+}
+
+// KV bytes one token costs in a single layer
+static size_t kv_layer_bytes_per_token(const KvLayout& layout, const KvCacheConfig& config) {
+    return ggml_row_size(config.type_k, (int64_t)layout.n_head_kv * layout.key_length) +
+           ggml_row_size(config.type_v, (int64_t)layout.n_head_kv * layout.value_length);
+}
+
+// The pinned llama.cpp allocates every layer for the full n_ctx, sliding-window ones included
+static size_t kv_cache_bytes(const KvLayout& layout, const KvCacheConfig& config, int n_ctx) {
+    return kv_layer_bytes_per_token(layout, config) * layout.n_layer * (size_t)n_ctx;
+}
+
+// Largest power-of-two context whose KV cache (as actually allocated) fits the RAM budget
+static int choose_context_length(const KvLayout& layout, const KvCacheConfig& config) {
+    int max_ctx = layout.n_ctx_train > 0 ? layout.n_ctx_train : MAX_CONTEXT_LENGTH;
+    if (config.n_ctx > 0) {
+        return std::min(config.n_ctx, max_ctx);
+    }
+
+    long pages = sysconf(_SC_PHYS_PAGES);
+    long page_size = sysconf(_SC_PAGE_SIZE);
+    if (pages <= 0 || page_size <= 0) {
+        return std::min(MAX_CONTEXT_LENGTH, max_ctx);
+    }
+    size_t budget = (size_t)pages * (size_t)page_size / KV_CACHE_RAM_FRACTION;
+
+    int n_ctx = MIN_CONTEXT_LENGTH;
+    while (n_ctx * 2 <= max_ctx && kv_cache_bytes(layout, config, n_ctx * 2) <= budget) {
+        n_ctx *= 2;
+    }
+    return n_ctx;
+}
+
+// Map an adapter file onto the shared base weights once; later calls and other contexts
+// reuse it. Only the adapter tensors are read, the base GGUF stays mapped as it is.
+static llama_lora_adapter* acquire_lora_adapter(SharedModel* shared, const std::string& path) {
+    std::lock_guard<std::mutex> lock(g_backend_mutex);
+
+    std::unordered_map<std::string, LoraAdapterRef>::iterator it = shared->adapters.find(path);
+    if (it != shared->adapters.end()) {
+        return it->second.adapter;
+    }
+
+    llama_lora_adapter* adapter = llama_lora_adapter_init(shared->model, path.c_str());
+    if (adapter == nullptr) {
+        log_android(LOG_TAG, "❌ Failed to load LoRA adapter " + path);
+        return nullptr;
+    }
+    shared->adapters[path].adapter = adapter;
+    log_android(LOG_TAG, "🧬 LoRA adapter loaded: " + path);
+    return adapter;
+}
+
+static void count_lora_user(SharedModel* shared, const std::string& path, int delta) {
+    if (path.empty()) return;
+    std::lock_guard<std::mutex> lock(g_backend_mutex);
+    std::unordered_map<std::string, LoraAdapterRef>::iterator it = shared->adapters.find(path);
+    if (it != shared->adapters.end()) {
+        it->second.users += delta;
+    }
+}
+
+// Where trimMemory parks an open side session's cells while the context is released
+static std::string side_spill_path(const LlamaModelWrapper* wrapper, const LlamaSession& session) {
+    return wrapper->model_path + TRIM_SPILL_SUFFIX + "." + std::to_string(session.seq_id);
+}
+
+// Put back the cells trimMemory spilled for `session`; its token history and turn boundaries
+// never left memory, so the file only counts if it holds exactly those tokens.
+// Caller holds ctx_mutex.
+static bool restore_side_session(LlamaModelWrapper* wrapper, LlamaSession& session) {
+    std::string path = side_spill_path(wrapper, session);
+    std::vector<llama_token> saved(session.tokens.size());
+    size_t n_saved = 0;
+    bool ok = session.tokens.size() > (size_t)wrapper->n_prefix &&
+              llama_state_seq_load_file((llama_context*)wrapper->ctx, path.c_str(), session.seq_id,
+                                        saved.data(), saved.size(), &n_saved) != 0 &&
+              n_saved == saved.size() && saved == session.tokens;
+    unlink(path.c_str());
+    if (!ok) {
+        llama_kv_cache_seq_rm((llama_context*)wrapper->ctx, session.seq_id, -1, -1);
+    }
+    return ok;
+}
+
+// Re-prime the system prefix (restored from its per-KV-type/adapter state file when one
+// exists) and rebase open side sessions on it; used whenever the cached cells are gone or stale.
+// After a trimMemory (`from_spill`) side sessions get their spilled turns back instead, and
+// one that cannot is closed so generateParallel reports it rather than answering without
+// its history. Caller holds ctx_mutex.
+static void rebuild_prefix_and_sessions(LlamaModelWrapper* wrapper, bool from_spill = false) {
+    prepare_prefix_cache(wrapper);
+
+    for (size_t i = 0; i < wrapper->parallel_sessions.size(); i++) {
+        LlamaSession& session = wrapper->parallel_sessions[i];
+        if (!session.in_use) continue;
+        if (from_spill && session.tokens.size() > (size_t)wrapper->n_prefix) {
+            if (!restore_side_session(wrapper, session)) {
+                log_android(LOG_TAG, "⚠️ Side session " + std::to_string(session.seq_id) +
+                                     " lost its history in trimMemory; closed");
+                release_session(wrapper, session);
+            }
+            continue;
+        }
+        llama_kv_cache_seq_cp((llama_context*)wrapper->ctx, PREFIX_SEQ_ID, session.seq_id, 0, wrapper->n_prefix);
+        session.tokens.assign(wrapper->prefix_tokens.begin(), wrapper->prefix_tokens.begin() + wrapper->n_prefix);
+        session.turn_starts.clear();
+        session.n_turns = 0;
+    }
+    wrapper->saved_session_path.clear();
+}
+
+// Apply `path` at `scale` to this context only; an empty path returns to the base weights.
+// The switch itself is a pointer swap in llama; the cost is re-priming the prefix cache.
+// Caller holds ctx_mutex.
+static bool apply_lora_adapter(LlamaModelWrapper* wrapper, const std::string& path, float scale) {
+    if (path == wrapper->lora_path && (path.empty() || scale == wrapper->lora_scale)) {
+        return true;
+    }
+    if (!ensure_context(wrapper)) return false;
+
+    auto start_time = std::chrono::steady_clock::now();
+    llama_lora_adapter* adapter = nullptr;
+    if (!path.empty()) {
+        adapter = acquire_lora_adapter(wrapper->shared_model, path);
+        if (adapter == nullptr) return false;
+    }
+
+    llama_context* ctx = (llama_context*)wrapper->ctx;
+    llama_lora_adapter_clear(ctx);
+    count_lora_user(wrapper->shared_model, wrapper->lora_path, -1);
+    wrapper->lora_path.clear();
+    wrapper->lora_scale = 0.0f;
+
+    bool ok = adapter == nullptr || llama_lora_adapter_set(ctx, adapter, scale) == 0;
+    if (ok && adapter != nullptr) {
+        wrapper->lora_path = path;
+        wrapper->lora_scale = scale;
+        count_lora_user(wrapper->shared_model, path, 1);
+    }
+
+    {
+        // Every cached cell was computed with the previous weights
+        TRACE_SECTION("llama:lora_switch");
+        rebuild_prefix_and_sessions(wrapper);
+    }
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start_time).count();
+    log_android(LOG_TAG, std::string(ok ? "🧬 Switched to " : "❌ Could not apply ") +
+                         (path.empty() ? std::string("base weights") : path) + " in " + std::to_string(ms) + " ms");
+    return ok;
+}
+
+static bool set_lora_adapter(LlamaModelWrapper* wrapper, const std::string& path, float scale) {
+    RequestLock lock(wrapper);
+    return apply_lora_adapter(wrapper, path, scale);
+}
+
+// Detach the adapter from this context and free it once no other context applies it
+static void unload_lora_adapter(LlamaModelWrapper* wrapper, const std::string& path) {
+    RequestLock lock(wrapper);
+    if (path == wrapper->lora_path) {
+        apply_lora_adapter(wrapper, std::string(), 0.0f);
+    }
+
+    std::lock_guard<std::mutex> registry_lock(g_backend_mutex);
+    SharedModel* shared = wrapper->shared_model;
+    std::unordered_map<std::string, LoraAdapterRef>::iterator it = shared->adapters.find(path);
+    if (it != shared->adapters.end() && it->second.users == 0) {
+        llama_lora_adapter_free(it->second.adapter);
+        shared->adapters.erase(it);
+    }
+}
+
+static llama_context* new_draft_context(LlamaModelWrapper* wrapper, SharedModel* shared) {
+    llama_context_params ctx_params = llama_context_default_params();
+    ctx_params.n_ctx = wrapper->context_size;
+    ctx_params.n_batch = PREFILL_CHUNK_SIZE;
+    ctx_params.n_ubatch = PREFILL_CHUNK_SIZE;
+    ctx_params.abort_callback = abort_requested;
+    ctx_params.abort_callback_data = wrapper;
+    ThreadPlan plan = plan_threads(wrapper->cpu_topology, THREAD_POLICY_INTERACTIVE);
+    ctx_params.n_threads = (int)plan.decode_cores.size();
+    ctx_params.n_threads_batch = (int)plan.batch_cores.size();
+    return llama_new_context_with_model(shared->model, ctx_params);
+}
+
+static void attach_draft_context(DraftModel& draft, llama_context* ctx) {
+    draft.ctx = ctx;
+    draft.batch_capacity = (int)llama_n_ubatch(ctx);
+    draft.batch = llama_batch_init(draft.batch_capacity, 0, 1);
+    draft.tokens.clear();
+}
+
+// Drop the draft's KV cache and compute buffers but keep its weights mapped
+static void free_draft_context(DraftModel& draft) {
+    if (draft.ctx == nullptr) return;
+    llama_batch_free(draft.batch);
+    llama_free(draft.ctx);
+    draft.ctx = nullptr;
+    draft.batch = llama_batch();
+    draft.batch_capacity = 0;
+    draft.tokens.clear();
+}
+
+static void free_draft_model(DraftModel& draft) {
+    free_draft_context(draft);
+    if (draft.shared) {
+        release_model(draft.shared);
+    }
+    draft = DraftModel();
+}
+
+// Load `path` as the draft model of `wrapper`; it must share the main model's vocabulary
+static bool load_draft_model(LlamaModelWrapper* wrapper, const std::string& path) {
+    SharedModel* shared = acquire_model(path);
+    if (shared == nullptr) {
+        return false;
+    }
+    if (llama_n_vocab(shared->model) != wrapper->vocab_size) {
+        log_android(LOG_TAG, "❌ Draft model vocabulary does not match the main model");
+        release_model(shared);
+        return false;
+    }
+
+    llama_context* ctx = new_draft_context(wrapper, shared);
+    if (ctx == nullptr) {
+        log_android(LOG_TAG, "❌ Failed to create draft context");
+        release_model(shared);
+        return false;
+    }
+
+    RequestLock lock(wrapper);
+    free_draft_model(wrapper->draft);
+    wrapper->draft.shared = shared;
+    attach_draft_context(wrapper->draft, ctx);
+    return true;
+}
+
+// Context parameters for Dream Assistant; also used to recreate the context after trimMemory
+static llama_context* new_context(LlamaModelWrapper* wrapper, int n_ctx) {
+    llama_context_params ctx_params = llama_context_default_params();
+    ctx_params.n_ctx = n_ctx;
+    ctx_params.type_k = wrapper->kv_config.type_k;
+    ctx_params.type_v = wrapper->kv_config.type_v;
+    // llama.cpp only supports a quantized V cache through the flash-attention path
+    ctx_params.flash_attn = wrapper->kv_config.type_v != GGML_TYPE_F16;
+    ctx_params.n_batch = PREFILL_CHUNK_SIZE;
+    ctx_params.n_ubatch = PREFILL_CHUNK_SIZE; // compute buffers are sized for one chunk
+    ctx_params.n_seq_max = MAX_PARALLEL_SEQUENCES;
+    ctx_params.no_perf = false; // getInferenceMetrics reports llama_perf timings
+    ctx_params.abort_callback = abort_requested;
+    ctx_params.abort_callback_data = wrapper;
+    // Thread counts follow the big.LITTLE layout instead of fixed numbers
+    ThreadPlan plan = plan_threads(wrapper->cpu_topology, THREAD_POLICY_INTERACTIVE);
+    ctx_params.n_threads = (int)plan.decode_cores.size();
+    ctx_params.n_threads_batch = (int)plan.batch_cores.size();
+    return llama_new_context_with_model((llama_model*)wrapper->model, ctx_params);
+}
+
+// Drop this process's resident pages of every mapping of `path` (llama's own mmap of the
+// GGUF included). The pages are clean, so they fault back in from the file when needed.
+static size_t release_mapped_pages(const std::string& path) {
+    FILE* maps = fopen("/proc/self/maps", "r");
+    if (maps == nullptr) return 0;
+
+    size_t released = 0;
+    char line[1024];
+    while (fgets(line, sizeof(line), maps) != nullptr) {
+        unsigned long start = 0, end = 0;
+        char perms[8];
+        int name_offset = 0;
+        if (sscanf(line, "%lx-%lx %7s %*s %*s %*s %n", &start, &end, perms, &name_offset) < 3 || name_offset == 0) {
+            continue;
+        }
+        std::string name(line + name_offset);
+        while (!name.empty() && (name[name.size() - 1] == '\n' || name[name.size() - 1] == ' ')) {
+            name.erase(name.size() - 1);
+        }
+        if (name != path || perms[1] == 'w') continue;
+
+        if (madvise((void*)start, end - start, MADV_DONTNEED) == 0) {
+            released += end - start;
+        }
+    }
+    fclose(maps);
+    return released;
+}
+
+// Release memory according to an onTrimMemory level; everything comes back lazily through
+// ensure_context on the next request. Returns the deepest TrimStage applied.
+static int trim_memory(LlamaModelWrapper* wrapper, int level) {
+    TRACE_SECTION("llama:trim_memory");
+    RequestLock lock(wrapper);
+    if (level < TRIM_MEMORY_RUNNING_MODERATE) return TRIM_STAGE_NONE;
+
+    // Caches that are cheap to refill
+    wrapper->token_cache.clear();
+    std::unordered_map<std::string, std::vector<llama_token> >().swap(wrapper->grammar_masks);
+    std::vector<llama_token_data>().swap(wrapper->candidates);
+    std::vector<uint8_t>().swap(wrapper->penalized);
+    int stage = TRIM_STAGE_CACHES;
+
+    // KV cache and compute buffers both live in the context, so it goes as a whole
+    if ((level == TRIM_MEMORY_RUNNING_CRITICAL || level >= TRIM_MEMORY_BACKGROUND) && wrapper->ctx != nullptr) {
+        const LlamaSession& session = wrapper->session;
+        if (session.tokens.size() > (size_t)wrapper->n_prefix) {
+            // Reuse an up-to-date saveSession file instead of writing a second copy
+            std::string spill = !wrapper->saved_session_path.empty() && wrapper->saved_session_tokens == session.tokens
+                                ? wrapper->saved_session_path : wrapper->model_path + TRIM_SPILL_SUFFIX;
+            if (save_session(wrapper, spill)) {
+                wrapper->spill_path = spill;
+            }
+        }
+        // Open side sessions keep their turns too; ensure_context puts them back
+        for (size_t i = 0; i < wrapper->parallel_sessions.size(); i++) {
+            const LlamaSession& side = wrapper->parallel_sessions[i];
+            if (!side.in_use || side.tokens.size() <= (size_t)wrapper->n_prefix) continue;
+            if (llama_state_seq_save_file((llama_context*)wrapper->ctx, side_spill_path(wrapper, side).c_str(),
+                                          side.seq_id, side.tokens.data(), side.tokens.size()) == 0) {
+                log_android(LOG_TAG, "⚠️ Could not spill side session " + std::to_string(side.seq_id));
+            }
+        }
+
+        free_draft_context(wrapper->draft);
+        llama_free((llama_context*)wrapper->ctx);
+        wrapper->ctx = nullptr;
+        free_threadpools(wrapper);
+        wrapper->active_thread_policy = -1;
+        wrapper->readiness.store(READINESS_MAPPED);
+        stage = TRIM_STAGE_CONTEXT;
+    }
+
+    if (level >= TRIM_MEMORY_MODERATE) {
+        size_t released = release_mapped_pages(wrapper->model_path);
+        if (wrapper->draft.shared != nullptr) {
+            released += release_mapped_pages(wrapper->draft.shared->path);
+        }
+        wrapper->readiness.store(READINESS_MAPPED);
+        log_android(LOG_TAG, "🧹 Released " + std::to_string(released >> 20) + " MB of weight pages");
+        stage = TRIM_STAGE_WEIGHTS;
+    }
+
+    log_android(LOG_TAG, "🧹 trimMemory(" + std::to_string(level) + "): stage " + std::to_string(stage));
+    return stage;
+}
+
+static bool ensure_context(LlamaModelWrapper* wrapper) {
+    if (wrapper->shutting_down.load()) {
+        return false;
+    }
+    if (wrapper->candidates.size() != (size_t)wrapper->vocab_size) {
+        wrapper->candidates.resize(wrapper->vocab_size);
+        wrapper->penalized.assign(wrapper->vocab_size, 0);
+    }
+    if (wrapper->ctx != nullptr) {
+        return true;
+    }
+
+    TRACE_SECTION("llama:restore_context");
+    auto start_time = std::chrono::steady_clock::now();
+    wrapper->ctx = new_context(wrapper, wrapper->context_size);
+    if (wrapper->ctx == nullptr) {
+        log_android(LOG_TAG, "❌ Failed to recreate context after trimMemory");
+        return false;
+    }
+    sync_thread_policy(wrapper);
+
+    if (!wrapper->lora_path.empty()) {
+        llama_lora_adapter* adapter = acquire_lora_adapter(wrapper->shared_model, wrapper->lora_path);
+        if (adapter != nullptr) {
+            llama_lora_adapter_set((llama_context*)wrapper->ctx, adapter, wrapper->lora_scale);
+        }
+    }
+    if (wrapper->draft.shared != nullptr) {
+        llama_context* draft_ctx = new_draft_context(wrapper, wrapper->draft.shared);
+        if (draft_ctx != nullptr) attach_draft_context(wrapper->draft, draft_ctx);
+    }
+
+    rebuild_prefix_and_sessions(wrapper, true);
+    if (!wrapper->spill_path.empty()) {
+        std::string spill = wrapper->spill_path;
+        wrapper->spill_path.clear();
+        load_session(wrapper, spill);
+        if (spill == wrapper->model_path + TRIM_SPILL_SUFFIX) {
+            unlink(spill.c_str());
+            wrapper->saved_session_path.clear();
+        }
+    }
+    // Without the prefix nothing has been decoded since the restore, so it stays MAPPED
+    if (wrapper->n_prefix > 0) {
+        wrapper->readiness.store(READINESS_PREFIX_CACHED);
+    }
+
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start_time).count();
+    log_android(LOG_TAG, "♻️ Context restored after trimMemory in " + std::to_string(ms) + " ms (" +
+                         std::to_string(wrapper->session.tokens.size()) + " tokens)");
+    return true;
+}
+
+// Create a context on a loaded model; the returned wrapper is READINESS_MAPPED.
+// n_ctx 0 takes the length from the KV cache config (or sizes it from device RAM).
+static LlamaModelWrapper* create_wrapper(SharedModel* shared, int n_ctx) {
+    TRACE_SECTION("llama:create_context");
+    // Create model wrapper
+    auto* wrapper = new LlamaModelWrapper();
+    wrapper->model_path = shared->path;
+    wrapper->model = shared->model;
+    {
+        std::lock_guard<std::mutex> lock(g_backend_mutex);
+        wrapper->kv_config = g_kv_config;
+    }
+
+    try {
+        KvLayout layout = read_kv_layout(shared->model);
+        if (n_ctx > 0) {
+            wrapper->kv_config.n_ctx = n_ctx;
+        }
+        n_ctx = choose_context_length(layout, wrapper->kv_config);
+
+        wrapper->cpu_topology = detect_cpu_topology();
+        log_android(LOG_TAG, "🧠 CPU topology: " + std::to_string(wrapper->cpu_topology.prime.size()) + "+" +
+                             std::to_string(wrapper->cpu_topology.mid.size()) + "+" +
+                             std::to_string(wrapper->cpu_topology.little.size()) + " cores");
+
+        log_android(LOG_TAG, "🗄️ KV cache " + std::string(ggml_type_name(wrapper->kv_config.type_k)) + "/" +
+                             ggml_type_name(wrapper->kv_config.type_v) + ", " + std::to_string(n_ctx) + " tokens: " +
+                             std::to_string(kv_cache_bytes(layout, wrapper->kv_config, n_ctx) >> 20) + " MB");
+
+        // Create context
+        wrapper->ctx = new_context(wrapper, n_ctx);
+        if (wrapper->ctx == nullptr) {
+            log_android(LOG_TAG, "❌ Failed to create context");
+            delete wrapper;
+            return nullptr;
+        }
+
+        // Take the model reference only once the wrapper is certain to exist
+        {
+            std::lock_guard<std::mutex> lock(g_backend_mutex);
+            shared->refs++;
+        }
+        wrapper->shared_model = shared;
+
+        wrapper->initialized = true;
+        wrapper->vocab_size = llama_n_vocab((llama_model*)wrapper->model);
+        wrapper->context_size = llama_n_ctx((llama_context*)wrapper->ctx);
+        int batch_capacity = (int)llama_n_ubatch((llama_context*)wrapper->ctx);
+        wrapper->batch = llama_batch_init(batch_capacity, 0, 1);
+        wrapper->batch_capacity = batch_capacity;
+        wrapper->parallel_sessions.resize(MAX_PARALLEL_SEQUENCES - 1);
+        for (int i = 0; i < MAX_PARALLEL_SEQUENCES - 1; i++) {
+            wrapper->parallel_sessions[i].seq_id = PREFIX_SEQ_ID + 1 + i;
+        }
+        init_sampler(wrapper);
+        build_chat_template(wrapper);
+        apply_thread_policy(wrapper, THREAD_POLICY_INTERACTIVE);
+
+        wrapper->readiness.store(READINESS_MAPPED);
+        return wrapper;
+
+    } catch (const std::exception& e) {
+        log_android(LOG_TAG, "❌ Exception during model initialization: " + std::string(e.what()));
+        if (wrapper->sampler) {
+            llama_sampler_free(wrapper->sampler);
+        }
+        free_threadpools(wrapper);
+        if (wrapper->batch_capacity > 0) {
+            llama_batch_free(wrapper->batch);
+        }
+        if (wrapper->ctx) {
+            llama_free((llama_context*)wrapper->ctx);
+        }
+        // Anything after the model reference was taken can still throw
+        if (wrapper->shared_model) {
+            release_model(wrapper->shared_model);
+        }
+        delete wrapper;
+        return nullptr;
+    }
+}
+
+// Load weights (or reuse them) and create the default-sized context
+static LlamaModelWrapper* load_wrapper(const std::string& path) {
+    SharedModel* shared = acquire_model(path);
+    if (shared == nullptr) {
+        return nullptr;
+    }
+
+    LlamaModelWrapper* wrapper = create_wrapper(shared, 0);
+    release_model(shared); // the wrapper holds its own reference
+    return wrapper;
+}
+
+
+extern "C" {
+
+JNIEXPORT jlong JNICALL
+Java_com_dreamassistant_ai_LlamaEngine_initializeModel(JNIEnv *env, jobject thiz, jstring modelPath) {
+    log_android(LOG_TAG, "🚀 Initializing Sister's Dream Assistant Model...");
+
+    std::string path = jstring_to_string(env, modelPath);
+    log_android(LOG_TAG, "Model path: " + path);
+
+    auto* wrapper = load_wrapper(path);
+    if (wrapper == nullptr) {
+        return 0;
+    }
+
+    if (prepare_prefix_cache(wrapper)) {
+        wrapper->readiness.store(READINESS_PREFIX_CACHED);
+        log_android(LOG_TAG, "📌 System prefix cached: " + std::to_string(wrapper->n_prefix) + " tokens");
+    }
+
+    log_android(LOG_TAG, "✅ Dream Assistant Model Loaded Successfully!");
+    log_android(LOG_TAG, "📊 Vocab size: " + std::to_string(wrapper->vocab_size));
+    log_android(LOG_TAG, "📊 Context size: " + std::to_string(wrapper->context_size));
+    log_android(LOG_TAG, "💕 Sister's personalized AI companion is ready!");
+
+    return reinterpret_cast<jlong>(wrapper);
+}
+
+JNIEXPORT jlong JNICALL
+Java_com_dreamassistant_ai_LlamaEngine_initializeModelAsync(JNIEnv *env, jobject thiz, jstring modelPath) {
+    log_android(LOG_TAG, "🚀 Initializing Sister's Dream Assistant Model (background warm-up)...");
+
+    std::string path = jstring_to_string(env, modelPath);
+    log_android(LOG_TAG, "Model path: " + path);
+
+    auto* wrapper = load_wrapper(path);
+    if (wrapper == nullptr) {
+        return 0;
+    }
+
+    // Synchronous requests issued before warm-up finishes wait on ctx_mutex; queued
+    // interactive ones preempt it at the next graph node
+    start_worker(env, wrapper);
+    wrapper->queue.submit(PRIORITY_BACKGROUND, [wrapper](bool cancelled) {
+        return cancelled || run_warmup(wrapper);
+    }, true);
+    log_android(LOG_TAG, "✅ Model mapped, warming up in the background");
+
+    return reinterpret_cast<jlong>(wrapper);
+}
+
+JNIEXPORT jint JNICALL
+Java_com_dreamassistant_ai_LlamaEngine_getReadinessState(JNIEnv *env, jobject thiz, jlong modelPtr) {
+    if (modelPtr == 0) return READINESS_FAILED;
+
+    auto* wrapper = reinterpret_cast<LlamaModelWrapper*>(modelPtr);
+    return wrapper->readiness.load();
+}
+
+JNIEXPORT jlong JNICALL
+Java_com_dreamassistant_ai_LlamaEngine_loadModel(JNIEnv *env, jobject thiz, jstring modelPath) {
+    std::string path = jstring_to_string(env, modelPath);
+    log_android(LOG_TAG, "📦 Loading model weights: " + path);
+
+    return reinterpret_cast<jlong>(acquire_model(path));
+}
+
+JNIEXPORT void JNICALL
+Java_com_dreamassistant_ai_LlamaEngine_configureKvCache(JNIEnv *env, jobject thiz, jint kvTypeK, jint kvTypeV,
+                                                        jint contextLength) {
+    std::lock_guard<std::mutex> lock(g_backend_mutex);
+
+    g_kv_config.type_k = kv_cache_ggml_type(kvTypeK);
+    g_kv_config.type_v = kv_cache_ggml_type(kvTypeV);
+    g_kv_config.n_ctx = contextLength > 0 ? contextLength : 0;
+    log_android(LOG_TAG, std::string("🗄️ KV cache for new contexts: ") + ggml_type_name(g_kv_config.type_k) + "/" +
+                         ggml_type_name(g_kv_config.type_v) +
+                         (g_kv_config.n_ctx > 0 ? ", " + std::to_string(g_kv_config.n_ctx) + " tokens"
+                                                : std::string(", length sized from RAM")));
+}
+
+JNIEXPORT jlong JNICALL
+Java_com_dreamassistant_ai_LlamaEngine_createContext(JNIEnv *env, jobject thiz, jlong modelHandle, jint contextLength) {
+    if (modelHandle == 0) return 0;
+
+    auto* shared = reinterpret_cast<SharedModel*>(modelHandle);
+    auto* wrapper = create_wrapper(shared, contextLength > 0 ? contextLength : 0);
+    if (wrapper == nullptr) {
+        return 0;
+    }
+
+    if (prepare_prefix_cache(wrapper)) {
+        wrapper->readiness.store(READINESS_PREFIX_CACHED);
+    }
+    log_android(LOG_TAG, "✅ Context created: " + std::to_string(wrapper->context_size) + " tokens");
+
+    return reinterpret_cast<jlong>(wrapper);
+}
+
+JNIEXPORT void JNICALL
+Java_com_dreamassistant_ai_LlamaEngine_releaseModel(JNIEnv *env, jobject thiz, jlong modelHandle) {
+    if (modelHandle == 0) return;
+
+    // Contexts created from this handle keep the weights alive until they are freed
+    release_model(reinterpret_cast<SharedModel*>(modelHandle));
+}
+
+JNIEXPORT jstring JNICALL
+Java_com_dreamassistant_ai_LlamaEngine_generateResponse(JNIEnv *env, jobject thiz, jlong modelPtr, jstring prompt) {
+    if (modelPtr == 0) {
+        log_android(LOG_TAG, "❌ Model not initialized");
+        return string_to_jstring(env, "Lo siento, el modelo no está inicializado. 😔");
+    }
+
+    auto* wrapper = reinterpret_cast<LlamaModelWrapper*>(modelPtr);
+    if (!wrapper->initialized) {
+        log_android(LOG_TAG, "❌ Model wrapper not initialized");
+        return string_to_jstring(env, "El Dream Assistant está despertando... inténtalo de nuevo. ✨");
+    }
+
+    std::string user_input = jstring_to_string(env, prompt);
+    log_android(LOG_TAG, "👤 Sister's input: " + user_input);
+
+    return string_to_jstring(env, run_chat_turn(wrapper, user_input, TurnCallbacks()));
+}
+
+JNIEXPORT jstring JNICALL
+Java_com_dreamassistant_ai_LlamaEngine_generateResponseStream(JNIEnv *env, jobject thiz, jlong modelPtr, jstring prompt,
+                                                              jobject callback) {
+    if (modelPtr == 0) {
+        log_android(LOG_TAG, "❌ Model not initialized");
+        return string_to_jstring(env, "Lo siento, el modelo no está inicializado. 😔");
+    }
+
+    auto* wrapper = reinterpret_cast<LlamaModelWrapper*>(modelPtr);
+    if (!wrapper->initialized) {
+        log_android(LOG_TAG, "❌ Model wrapper not initialized");
+        return string_to_jstring(env, "El Dream Assistant está despertando... inténtalo de nuevo. ✨");
+    }
+
+    std::string user_input = jstring_to_string(env, prompt);
+    log_android(LOG_TAG, "👤 Sister's input (streaming): " + user_input);
+
+    // TokenStreamCallback.onToken(ByteArray): Boolean - raw UTF-8, so emoji survive intact
+    TurnCallbacks callbacks;
+    callbacks.on_piece = make_byte_array_callback(env, callback, "onToken");
+    callbacks.on_progress = make_progress_callback(env, callback);
+
+    return string_to_jstring(env, run_chat_turn(wrapper, user_input, callbacks));
+}
+
+JNIEXPORT jstring JNICALL
+Java_com_dreamassistant_ai_LlamaEngine_generateResponseSentences(JNIEnv *env, jobject thiz, jlong modelPtr, jstring prompt,
+                                                                 jobject callback) {
+    if (modelPtr == 0) {
+        log_android(LOG_TAG, "❌ Model not initialized");
+        return string_to_jstring(env, "Lo siento, el modelo no está inicializado. 😔");
+    }
+
+    auto* wrapper = reinterpret_cast<LlamaModelWrapper*>(modelPtr);
+    if (!wrapper->initialized) {
+        log_android(LOG_TAG, "❌ Model wrapper not initialized");
+        return string_to_jstring(env, "El Dream Assistant está despertando... inténtalo de nuevo. ✨");
+    }
+
+    std::string user_input = jstring_to_string(env, prompt);
+    log_android(LOG_TAG, "👤 Sister's input (spoken): " + user_input);
+
+    // SentenceStreamCallback.onSentence(ByteArray): Boolean - one complete sentence per call
+    TurnCallbacks callbacks;
+    callbacks.on_sentence = make_byte_array_callback(env, callback, "onSentence");
+    callbacks.on_progress = make_progress_callback(env, callback);
+
+    return string_to_jstring(env, run_chat_turn(wrapper, user_input, callbacks));
+}
+
+JNIEXPORT jlong JNICALL
+Java_com_dreamassistant_ai_LlamaEngine_submitResponse(JNIEnv *env, jobject thiz, jlong modelPtr, jstring prompt,
+                                                     jint priority, jobject callback) {
+    if (modelPtr == 0 || callback == nullptr) return 0;
+
+    auto* wrapper = reinterpret_cast<LlamaModelWrapper*>(modelPtr);
+    if (!wrapper->initialized) return 0;
+
+    std::string user_input = jstring_to_string(env, prompt);
+    log_android(LOG_TAG, "👤 Sister's input (queued, priority " + std::to_string(priority) + "): " + user_input);
+
+    start_worker(env, wrapper);
+    jobject callback_ref = env->NewGlobalRef(callback);
+    // RequestCallback.onToken/onComplete(ByteArray): Boolean, called on the worker thread;
+    // an empty completion means the request was cancelled before it produced anything
+    uint64_t id = wrapper->queue.submit(priority, [wrapper, user_input, callback_ref](bool cancelled) {
+        JNIEnv* worker_env = t_worker_env;
+        if (worker_env == nullptr) return true;
+
+        std::string response;
+        if (!cancelled) {
+            TurnCallbacks callbacks;
+            callbacks.on_piece = make_byte_array_callback(worker_env, callback_ref, "onToken");
+            response = run_chat_turn(wrapper, user_input, callbacks);
+        }
+        PieceCallback on_complete = make_byte_array_callback(worker_env, callback_ref, "onComplete");
+        if (on_complete) on_complete(response.data(), response.size());
+        worker_env->DeleteGlobalRef(callback_ref);
+        return true;
+    }, false);
+
+    if (id == 0) {
+        env->DeleteGlobalRef(callback_ref);
+        log_android(LOG_TAG, "❌ Request queue is shut down");
+    }
+    return (jlong)id;
+}
+
+JNIEXPORT void JNICALL
+Java_com_dreamassistant_ai_LlamaEngine_cancelRequest(JNIEnv *env, jobject thiz, jlong modelPtr, jlong requestId) {
+    if (modelPtr == 0 || requestId == 0) return;
+
+    auto* wrapper = reinterpret_cast<LlamaModelWrapper*>(modelPtr);
+    // Queued: its onComplete("") runs on the worker. Running: stop it like cancelGeneration.
+    if (!wrapper->queue.cancel((uint64_t)requestId) && wrapper->queue.running_id() == (uint64_t)requestId) {
+        wrapper->cancel_epoch.fetch_add(1);
+    }
+    log_android(LOG_TAG, "⏹️ Cancel requested for request " + std::to_string((long long)requestId));
+}
+
+JNIEXPORT jint JNICALL
+Java_com_dreamassistant_ai_LlamaEngine_generateResponseDirect(JNIEnv *env, jobject thiz, jlong modelPtr,
+                                                              jobject inputBuffer, jint inputLength,
+                                                              jobject outputBuffer, jobject callback) {
+    if (modelPtr == 0) return -1;
+
+    auto* wrapper = reinterpret_cast<LlamaModelWrapper*>(modelPtr);
+    if (!wrapper->initialized) return -1;
+
+    const char* input = static_cast<const char*>(env->GetDirectBufferAddress(inputBuffer));
+    char* output = static_cast<char*>(env->GetDirectBufferAddress(outputBuffer));
+    jlong input_capacity = env->GetDirectBufferCapacity(inputBuffer);
+    jlong output_capacity = env->GetDirectBufferCapacity(outputBuffer);
+    if (input == nullptr || output == nullptr || inputLength < 0 || inputLength > input_capacity) {
+        log_android(LOG_TAG, "❌ generateResponseDirect needs direct ByteBuffers");
+        return -1;
+    }
+
+    // Real UTF-8 straight from Kotlin - no modified-UTF-8 round trip
+    std::string user_input(input, inputLength);
+    log_android(LOG_TAG, "👤 Sister's input (direct): " + user_input);
+
+    TurnCallbacks callbacks;
+    callbacks.on_piece = make_direct_buffer_callback(env, callback, output, (size_t)output_capacity);
+    callbacks.on_progress = make_progress_callback(env, callback);
+
+    std::string response = run_chat_turn(wrapper, user_input, callbacks);
+
+    // Final reply replaces the last piece; truncate on a character boundary if it does not fit
+    size_t n_out = std::min(response.size(), (size_t)output_capacity);
+    n_out = utf8_complete_prefix(response.substr(0, n_out));
+    memcpy(output, response.data(), n_out);
+    return (jint)n_out;
+}
+
+JNIEXPORT void JNICALL
+Java_com_dreamassistant_ai_LlamaEngine_resetSession(JNIEnv *env, jobject thiz, jlong modelPtr) {
+    if (modelPtr == 0) return;
+
+    auto* wrapper = reinterpret_cast<LlamaModelWrapper*>(modelPtr);
+    if (!wrapper->initialized) return;
+
+    RequestLock lock(wrapper);
+    if (wrapper->ctx == nullptr) {
+        wrapper->spill_path.clear(); // nothing to restore; the rebuilt context starts fresh
+    } else {
+        session_reset(wrapper);
+    }
+    log_android(LOG_TAG, "🔄 Conversation reset to system prefix");
 }
 
-jstring string_to_jstring(JNIEnv* env, const std::string& str) {
-    return env->NewStringUTF(str.c_str());
+JNIEXPORT jint JNICALL
+Java_com_dreamassistant_ai_LlamaEngine_prefillPartial(JNIEnv *env, jobject thiz, jlong modelPtr, jstring partialText) {
+    if (modelPtr == 0) return -1;
+
+    auto* wrapper = reinterpret_cast<LlamaModelWrapper*>(modelPtr);
+    if (!wrapper->initialized) return -1;
+
+    return prefill_partial(wrapper, jstring_to_string(env, partialText));
 }
 
-void log_android(const std::string& tag, const std::string& message) {
-    __android_log_print(ANDROID_LOG_INFO, tag.c_str(), "%s", message.c_str());
+JNIEXPORT void JNICALL
+Java_com_dreamassistant_ai_LlamaEngine_discardPartial(JNIEnv *env, jobject thiz, jlong modelPtr) {
+    if (modelPtr == 0) return;
+
+    auto* wrapper = reinterpret_cast<LlamaModelWrapper*>(modelPtr);
+    RequestLock lock(wrapper);
+    if (wrapper->ctx != nullptr) {
+        discard_partial_prefill(wrapper);
+    }
 }
 
-// Sister-specific prompting for Dream Assistant
-std::string create_sister_prompt(const std::string& user_input) {
-    return "Eres el Dream Assistant, la compañera perfecta para mi hermana emprendedora. "
-           "Ella tiene dificultades del habla pero sueña con crear su plataforma digital. "
-           "Responde de manera cariñosa, motivacional y práctica. "
-           "Entiende que ella necesita apoyo emocional y técnico para lograr sus metas.\n\n"
-           "Usuario: " + user_input + "\n"
-                                      "Dream Assistant: ";
+JNIEXPORT jboolean JNICALL
+Java_com_dreamassistant_ai_LlamaEngine_loadLoraAdapter(JNIEnv *env, jobject thiz, jlong modelPtr, jstring adapterPath) {
+    if (modelPtr == 0) {
+        return JNI_FALSE;
+    }
+
+    auto* wrapper = reinterpret_cast<LlamaModelWrapper*>(modelPtr);
+    if (!wrapper->initialized) {
+        return JNI_FALSE;
+    }
+
+    return acquire_lora_adapter(wrapper->shared_model, jstring_to_string(env, adapterPath)) != nullptr ? JNI_TRUE : JNI_FALSE;
 }
 
-extern "C" {
+JNIEXPORT jboolean JNICALL
+Java_com_dreamassistant_ai_LlamaEngine_setLoraAdapter(JNIEnv *env, jobject thiz, jlong modelPtr, jstring adapterPath, jfloat scale) {
+    if (modelPtr == 0) {
+        return JNI_FALSE;
+    }
 
-JNIEXPORT jlong JNICALL
-Java_com_dreamassistant_ai_LlamaEngine_initializeModel(JNIEnv *env, jobject thiz, jstring modelPath) {
-    log_android(LOG_TAG, "🚀 Initializing Sister's Dream Assistant Model...");
+    auto* wrapper = reinterpret_cast<LlamaModelWrapper*>(modelPtr);
+    if (!wrapper->initialized) {
+        return JNI_FALSE;
+    }
 
-    std::string path = jstring_to_string(env, modelPath);
-    log_android(LOG_TAG, "Model path: " + path);
+    std::string path = adapterPath != nullptr ? jstring_to_string(env, adapterPath) : std::string();
+    return set_lora_adapter(wrapper, path, scale) ? JNI_TRUE : JNI_FALSE;
+}
 
-    // Create model wrapper
-    auto* wrapper = new LlamaModelWrapper();
-    wrapper->model_path = path;
+JNIEXPORT void JNICALL
+Java_com_dreamassistant_ai_LlamaEngine_unloadLoraAdapter(JNIEnv *env, jobject thiz, jlong modelPtr, jstring adapterPath) {
+    if (modelPtr == 0) return;
 
-    try {
-        // Initialize llama backend
-        llama_backend_init();
-        llama_numa_init(GGML_NUMA_STRATEGY_DISABLED);
+    auto* wrapper = reinterpret_cast<LlamaModelWrapper*>(modelPtr);
+    if (!wrapper->initialized) return;
 
-        // Model parameters optimized for sister's use case
-        llama_model_params model_params = llama_model_default_params();
-        model_params.n_gpu_layers = 0; // CPU only for Android
-        model_params.use_mmap = true;
-        model_params.use_mlock = false;
+    unload_lora_adapter(wrapper, jstring_to_string(env, adapterPath));
+}
 
-        // Load the model
-        wrapper->model = llama_load_model_from_file(path.c_str(), model_params);
-        if (wrapper->model == nullptr) {
-            log_android(LOG_TAG, "❌ Failed to load model");
-            delete wrapper;
-            return 0;
-        }
+JNIEXPORT jboolean JNICALL
+Java_com_dreamassistant_ai_LlamaEngine_setSpeculativeMode(JNIEnv *env, jobject thiz, jlong modelPtr, jint mode, jint maxDraft) {
+    if (modelPtr == 0) return JNI_FALSE;
 
-        // Context parameters for Dream Assistant
-        llama_context_params ctx_params = llama_context_default_params();
-        ctx_params.seed = 1234;
-        ctx_params.n_ctx = MAX_CONTEXT_LENGTH;
-        ctx_params.n_threads = 4; // Optimize for mobile
-        ctx_params.n_threads_batch = 2;
+    auto* wrapper = reinterpret_cast<LlamaModelWrapper*>(modelPtr);
+    if (!wrapper->initialized || mode < SPEC_MODE_OFF || mode > SPEC_MODE_DRAFT_MODEL) return JNI_FALSE;
 
-        // Create context
-        wrapper->ctx = llama_new_context_with_model((llama_model*)wrapper->model, ctx_params);
-        if (wrapper->ctx == nullptr) {
-            log_android(LOG_TAG, "❌ Failed to create context");
-            llama_free_model((llama_model*)wrapper->model);
-            delete wrapper;
-            return 0;
-        }
+    RequestLock lock(wrapper);
+    if (mode == SPEC_MODE_DRAFT_MODEL && wrapper->draft.shared == nullptr) {
+        log_android(LOG_TAG, "⚠️ Draft-model speculation needs loadDraftModel first");
+        return JNI_FALSE;
+    }
 
-        wrapper->initialized = true;
-        wrapper->vocab_size = llama_n_vocab((llama_model*)wrapper->model);
-        wrapper->context_size = llama_n_ctx((llama_context*)wrapper->ctx);
+    wrapper->spec_mode = mode;
+    wrapper->spec_max_draft = std::max(1, std::min((int)maxDraft, SPEC_MAX_DRAFT));
+    log_android(LOG_TAG, "🔮 Speculative mode " + std::to_string(mode) + ", up to " +
+                         std::to_string(wrapper->spec_max_draft) + " draft tokens");
+    return JNI_TRUE;
+}
 
-        log_android(LOG_TAG, "✅ Dream Assistant Model Loaded Successfully!");
-        log_android(LOG_TAG, "📊 Vocab size: " + std::to_string(wrapper->vocab_size));
-        log_android(LOG_TAG, "📊 Context size: " + std::to_string(wrapper->context_size));
-        log_android(LOG_TAG, "💕 Sister's personalized AI companion is ready!");
+JNIEXPORT jboolean JNICALL
+Java_com_dreamassistant_ai_LlamaEngine_loadDraftModel(JNIEnv *env, jobject thiz, jlong modelPtr, jstring draftPath) {
+    if (modelPtr == 0) return JNI_FALSE;
 
-        return reinterpret_cast<jlong>(wrapper);
+    auto* wrapper = reinterpret_cast<LlamaModelWrapper*>(modelPtr);
+    if (!wrapper->initialized) return JNI_FALSE;
 
-    } catch (const std::exception& e) {
-        log_android(LOG_TAG, "❌ Exception during model initialization: " + std::string(e.what()));
-        delete wrapper;
-        return 0;
-    }
+    std::string path = jstring_to_string(env, draftPath);
+    log_android(LOG_TAG, "📦 Loading draft model: " + path);
+    return load_draft_model(wrapper, path) ? JNI_TRUE : JNI_FALSE;
+}
+
+JNIEXPORT jlongArray JNICALL
+Java_com_dreamassistant_ai_LlamaEngine_getSpeculativeStats(JNIEnv *env, jobject thiz, jlong modelPtr) {
+    jlongArray result = env->NewLongArray(3);
+    if (modelPtr == 0 || result == nullptr) return result;
+
+    auto* wrapper = reinterpret_cast<LlamaModelWrapper*>(modelPtr);
+    jlong values[3] = {
+            (jlong)wrapper->spec_stats.n_steps.load(),
+            (jlong)wrapper->spec_stats.n_drafted.load(),
+            (jlong)wrapper->spec_stats.n_accepted.load()
+    };
+    env->SetLongArrayRegion(result, 0, 3, values);
+    return result;
 }
 
 JNIEXPORT jstring JNICALL
-Java_com_dreamassistant_ai_LlamaEngine_generateResponse(JNIEnv *env, jobject thiz, jlong modelPtr, jstring prompt) {
+Java_com_dreamassistant_ai_LlamaEngine_generateAction(JNIEnv *env, jobject thiz, jlong modelPtr, jstring prompt, jstring grammar) {
     if (modelPtr == 0) {
-        log_android(LOG_TAG, "❌ Model not initialized");
-        return string_to_jstring(env, "Lo siento, el modelo no está inicializado. 😔");
+        return string_to_jstring(env, "");
     }
 
     auto* wrapper = reinterpret_cast<LlamaModelWrapper*>(modelPtr);
     if (!wrapper->initialized) {
-        log_android(LOG_TAG, "❌ Model wrapper not initialized");
-        return string_to_jstring(env, "El Dream Assistant está despertando... inténtalo de nuevo. ✨");
+        return string_to_jstring(env, "");
     }
 
     std::string user_input = jstring_to_string(env, prompt);
-    log_android(LOG_TAG, "👤 Sister's input: " + user_input);
+    std::string grammar_text = grammar != nullptr ? jstring_to_string(env, grammar) : std::string(ACTION_GRAMMAR);
+    return string_to_jstring(env, run_action_turn(wrapper, user_input, grammar_text));
+}
 
-    // Create sister-specific prompt
-    std::string full_prompt = create_sister_prompt(user_input);
+JNIEXPORT jint JNICALL
+Java_com_dreamassistant_ai_LlamaEngine_trimMemory(JNIEnv *env, jobject thiz, jlong modelPtr, jint level) {
+    if (modelPtr == 0) return TRIM_STAGE_NONE;
 
-    auto start_time = std::chrono::high_resolution_clock::now();
+    auto* wrapper = reinterpret_cast<LlamaModelWrapper*>(modelPtr);
+    if (!wrapper->initialized) return TRIM_STAGE_NONE;
 
-    try {
-        // Tokenize the prompt
-        std::vector<llama_token> tokens;
-        tokens.resize(full_prompt.length() + 1);
-        int n_tokens = llama_tokenize(
-                (llama_model*)wrapper->model,
-                full_prompt.c_str(),
-                full_prompt.length(),
-                tokens.data(),
-                tokens.size(),
-                true, // add_special
-                true  // parse_special
-        );
-        tokens.resize(n_tokens);
-
-        log_android(LOG_TAG, "🔤 Tokenized " + std::to_string(n_tokens) + " tokens");
-
-        // Clear previous context
-        llama_kv_cache_clear((llama_context*)wrapper->ctx);
+    return trim_memory(wrapper, level);
+}
 
-        // Evaluate the prompt
-        if (llama_decode((llama_context*)wrapper->ctx, llama_batch_get_one(tokens.data(), n_tokens)) != 0) {
-            log_android(LOG_TAG, "❌ Failed to evaluate prompt");
-            return string_to_jstring(env, "Disculpa, tuve un problema procesando tu mensaje. 😅");
-        }
+JNIEXPORT jboolean JNICALL
+Java_com_dreamassistant_ai_LlamaEngine_saveSession(JNIEnv *env, jobject thiz, jlong modelPtr, jstring path) {
+    if (modelPtr == 0) {
+        return JNI_FALSE;
+    }
 
-        // Generate response
-        std::string response = "";
-        int max_tokens = 150; // Balanced for mobile performance
+    auto* wrapper = reinterpret_cast<LlamaModelWrapper*>(modelPtr);
+    if (!wrapper->initialized) {
+        return JNI_FALSE;
+    }
 
-        for (int i = 0; i < max_tokens; i++) {
-            // Get logits and sample next token
-            float* logits = llama_get_logits((llama_context*)wrapper->ctx);
+    std::string session_path = jstring_to_string(env, path);
+    RequestLock lock(wrapper);
+    if (wrapper->ctx == nullptr) {
+        // Trimmed: the conversation already sits in the spill file, move it instead of rebuilding
+        if (wrapper->spill_path.empty() || wrapper->spill_path == session_path) return JNI_TRUE;
+        if (std::rename(wrapper->spill_path.c_str(), session_path.c_str()) != 0) return JNI_FALSE;
+        wrapper->spill_path = session_path;
+        wrapper->saved_session_path = session_path;
+        return JNI_TRUE;
+    }
+    return save_session(wrapper, session_path) ? JNI_TRUE : JNI_FALSE;
+}
 
-            // Sample with Dream Assistant personality parameters
-            llama_token next_token = llama_sample_token_greedy(
-                    (llama_context*)wrapper->ctx,
-                    nullptr
-            );
+JNIEXPORT jboolean JNICALL
+Java_com_dreamassistant_ai_LlamaEngine_loadSession(JNIEnv *env, jobject thiz, jlong modelPtr, jstring path) {
+    if (modelPtr == 0) {
+        return JNI_FALSE;
+    }
 
-            // Check for end of sequence
-            if (llama_token_is_eog((llama_model*)wrapper->model, next_token)) {
-                break;
-            }
+    auto* wrapper = reinterpret_cast<LlamaModelWrapper*>(modelPtr);
+    if (!wrapper->initialized) {
+        return JNI_FALSE;
+    }
 
-            // Convert token to string
-            char token_str[256];
-            int token_len = llama_token_to_piece(
-                    (llama_model*)wrapper->model,
-                    next_token,
-                    token_str,
-                    sizeof(token_str),
-                    0,
-                    true
-            );
-
-            if (token_len > 0) {
-                response.append(token_str, token_len);
-            }
+    std::string session_path = jstring_to_string(env, path);
+    RequestLock lock(wrapper);
+    if (!ensure_context(wrapper)) return JNI_FALSE;
+    return load_session(wrapper, session_path) ? JNI_TRUE : JNI_FALSE;
+}
 
-            // Evaluate the new token
-            if (llama_decode((llama_context*)wrapper->ctx, llama_batch_get_one(&next_token, 1)) != 0) {
-                log_android(LOG_TAG, "❌ Failed to evaluate token");
-                break;
-            }
+JNIEXPORT jfloatArray JNICALL
+Java_com_dreamassistant_ai_LlamaEngine_getEmbedding(JNIEnv *env, jobject thiz, jlong modelPtr, jstring text) {
+    if (modelPtr == 0) {
+        return env->NewFloatArray(0);
+    }
 
-            // Stop if we detect natural conversation ending
-            if (response.find(".") != std::string::npos && response.length() > 50) {
-                break;
-            }
+    auto* wrapper = reinterpret_cast<LlamaModelWrapper*>(modelPtr);
+    if (!wrapper->initialized) {
+        return env->NewFloatArray(0);
+    }
+
+    std::vector<float> embedding;
+    {
+        RequestLock lock(wrapper);
+        if (!ensure_context(wrapper) || !embed_text(wrapper, jstring_to_string(env, text), embedding)) {
+            embedding.clear();
         }
+    }
 
-        auto end_time = std::chrono::high_resolution_clock::now();
-        auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end_time - start_time);
-        wrapper->last_inference_time = duration.count() / 1000.0f;
+    jfloatArray result = env->NewFloatArray((jsize)embedding.size());
+    env->SetFloatArrayRegion(result, 0, (jsize)embedding.size(), embedding.data());
+    return result;
+}
 
-        // Clean up response
-        if (response.empty()) {
-            response = "¡Hola! Soy tu Dream Assistant. ¿En qué te puedo ayudar hoy? 😊";
+JNIEXPORT jboolean JNICALL
+Java_com_dreamassistant_ai_LlamaEngine_addIntentExemplar(JNIEnv *env, jobject thiz, jlong modelPtr, jstring label, jstring text) {
+    if (modelPtr == 0) {
+        return JNI_FALSE;
+    }
+
+    auto* wrapper = reinterpret_cast<LlamaModelWrapper*>(modelPtr);
+    if (!wrapper->initialized) {
+        return JNI_FALSE;
+    }
+
+    // Embedding exemplars is background work; a reply submitted meanwhile goes first
+    std::string label_text = jstring_to_string(env, label);
+    std::string exemplar = jstring_to_string(env, text);
+    start_worker(env, wrapper);
+    uint64_t id = wrapper->queue.submit(PRIORITY_BACKGROUND, [wrapper, label_text, exemplar](bool cancelled) {
+        if (cancelled || wrapper->shutting_down.load()) return true;
+        DecodeStatus status = add_intent_exemplar(wrapper, label_text, exemplar);
+        // Cut short by a reply (cancelGeneration or preemption): embed it again after that
+        if (status == DECODE_CANCELLED) return false;
+        if (status == DECODE_FAILED) {
+            log_android(LOG_TAG, "❌ Intent exemplar '" + label_text + "' not added");
         }
+        return true;
+    }, true);
+    return id != 0 ? JNI_TRUE : JNI_FALSE;
+}
 
-        log_android(LOG_TAG, "🤖 Dream Assistant response: " + response);
-        log_android(LOG_TAG, "⚡ Generation time: " + std::to_string(wrapper->last_inference_time) + "s");
+JNIEXPORT jstring JNICALL
+Java_com_dreamassistant_ai_LlamaEngine_matchIntent(JNIEnv *env, jobject thiz, jlong modelPtr, jstring text, jfloat minScore) {
+    if (modelPtr == 0) {
+        return string_to_jstring(env, "");
+    }
 
-        return string_to_jstring(env, response);
+    auto* wrapper = reinterpret_cast<LlamaModelWrapper*>(modelPtr);
+    if (!wrapper->initialized) {
+        return string_to_jstring(env, "");
+    }
 
-    } catch (const std::exception& e) {
-        log_android(LOG_TAG, "❌ Exception during generation: " + std::string(e.what()));
-        return string_to_jstring(env, "Ups, tuve un pequeño problema. ¡Pero estoy aquí para ti! 💪");
+    return string_to_jstring(env, match_intent(wrapper, jstring_to_string(env, text), minScore));
+}
+
+JNIEXPORT void JNICALL
+Java_com_dreamassistant_ai_LlamaEngine_clearIntents(JNIEnv *env, jobject thiz, jlong modelPtr) {
+    if (modelPtr == 0) return;
+
+    auto* wrapper = reinterpret_cast<LlamaModelWrapper*>(modelPtr);
+    RequestLock lock(wrapper);
+    wrapper->intents = IntentIndex();
+}
+
+JNIEXPORT jint JNICALL
+Java_com_dreamassistant_ai_LlamaEngine_openSession(JNIEnv *env, jobject thiz, jlong modelPtr) {
+    if (modelPtr == 0) return -1;
+
+    auto* wrapper = reinterpret_cast<LlamaModelWrapper*>(modelPtr);
+    if (!wrapper->initialized) return -1;
+
+    int seq_id = open_session(wrapper);
+    log_android(LOG_TAG, seq_id >= 0 ? "🧵 Opened session " + std::to_string(seq_id)
+                                     : std::string("⚠️ No free session slot"));
+    return seq_id;
+}
+
+JNIEXPORT void JNICALL
+Java_com_dreamassistant_ai_LlamaEngine_closeSession(JNIEnv *env, jobject thiz, jlong modelPtr, jint sessionId) {
+    if (modelPtr == 0) return;
+
+    auto* wrapper = reinterpret_cast<LlamaModelWrapper*>(modelPtr);
+    if (!wrapper->initialized) return;
+
+    close_session(wrapper, sessionId);
+}
+
+JNIEXPORT jobjectArray JNICALL
+Java_com_dreamassistant_ai_LlamaEngine_generateParallel(JNIEnv *env, jobject thiz, jlong modelPtr,
+                                                        jintArray sessionIds, jobjectArray prompts, jintArray maxTokens) {
+    jclass string_class = env->FindClass("java/lang/String");
+    jsize n = prompts != nullptr ? env->GetArrayLength(prompts) : 0;
+    if (sessionIds == nullptr || maxTokens == nullptr ||
+        env->GetArrayLength(sessionIds) != n || env->GetArrayLength(maxTokens) != n) {
+        n = 0;
+    }
+    jobjectArray result = env->NewObjectArray(n, string_class, nullptr);
+    if (modelPtr == 0 || n == 0) return result;
+
+    auto* wrapper = reinterpret_cast<LlamaModelWrapper*>(modelPtr);
+    if (!wrapper->initialized) return result;
+
+    std::vector<int> seq_ids(n);
+    std::vector<int> limits(n);
+    std::vector<std::string> inputs(n);
+    env->GetIntArrayRegion(sessionIds, 0, n, reinterpret_cast<jint*>(seq_ids.data()));
+    env->GetIntArrayRegion(maxTokens, 0, n, reinterpret_cast<jint*>(limits.data()));
+    for (jsize i = 0; i < n; i++) {
+        jstring prompt = (jstring)env->GetObjectArrayElement(prompts, i);
+        inputs[i] = prompt != nullptr ? jstring_to_string(env, prompt) : std::string();
+        env->DeleteLocalRef(prompt);
+        if (limits[i] <= 0) limits[i] = MAX_RESPONSE_TOKENS;
+    }
+
+    std::vector<std::string> responses = run_parallel_turns(wrapper, seq_ids, inputs, limits);
+    for (jsize i = 0; i < n; i++) {
+        jstring text = string_to_jstring(env, responses[i]);
+        env->SetObjectArrayElement(result, i, text);
+        env->DeleteLocalRef(text);
+    }
+    return result;
+}
+
+JNIEXPORT jlong JNICALL
+Java_com_dreamassistant_ai_LlamaEngine_submitBatch(JNIEnv *env, jobject thiz, jlong modelPtr, jobjectArray keys,
+                                                  jobjectArray prompts, jint maxTokens, jstring cachePath,
+                                                  jobject callback) {
+    jsize n = prompts != nullptr ? env->GetArrayLength(prompts) : 0;
+    if (modelPtr == 0 || n == 0 || keys == nullptr || env->GetArrayLength(keys) != n ||
+        cachePath == nullptr || callback == nullptr) {
+        return 0;
+    }
+
+    auto* wrapper = reinterpret_cast<LlamaModelWrapper*>(modelPtr);
+    if (!wrapper->initialized) return 0;
+
+    std::shared_ptr<BatchJob> job(new BatchJob());
+    job->max_tokens = maxTokens > 0 ? maxTokens : MAX_RESPONSE_TOKENS;
+    job->cache_path = jstring_to_string(env, cachePath);
+    for (jsize i = 0; i < n; i++) {
+        jstring key = (jstring)env->GetObjectArrayElement(keys, i);
+        jstring prompt = (jstring)env->GetObjectArrayElement(prompts, i);
+        job->keys.push_back(key != nullptr ? jstring_to_string(env, key) : std::string());
+        job->prompts.push_back(prompt != nullptr ? jstring_to_string(env, prompt) : std::string());
+        env->DeleteLocalRef(key);
+        env->DeleteLocalRef(prompt);
+    }
+    log_android(LOG_TAG, "📦 Batch of " + std::to_string(n) + " prompts queued for " + job->cache_path);
+
+    start_worker(env, wrapper);
+    jobject callback_ref = env->NewGlobalRef(callback);
+    // RequestCallback.onComplete gets the cache path once it is written, or "" on failure/cancel
+    uint64_t id = wrapper->queue.submit(PRIORITY_BACKGROUND, [wrapper, job, callback_ref](bool cancelled) {
+        JNIEnv* worker_env = t_worker_env;
+        if (worker_env == nullptr) return true;
+
+        bool written = false;
+        if (!cancelled && !run_batch_job(wrapper, *job, written)) {
+            return false; // yielded; resumes with the next unanswered prompt
+        }
+        std::string result = written ? job->cache_path : std::string();
+        PieceCallback on_complete = make_byte_array_callback(worker_env, callback_ref, "onComplete");
+        if (on_complete) on_complete(result.data(), result.size());
+        worker_env->DeleteGlobalRef(callback_ref);
+        return true;
+    }, true);
+
+    if (id == 0) {
+        env->DeleteGlobalRef(callback_ref);
+        log_android(LOG_TAG, "❌ Request queue is shut down");
     }
+    return (jlong)id;
+}
+
+JNIEXPORT jboolean JNICALL
+Java_com_dreamassistant_ai_LlamaEngine_setSamplingParams(JNIEnv *env, jobject thiz, jlong modelPtr, jfloat temperature,
+                                                         jint topK, jfloat topP, jfloat repeatPenalty, jint seed) {
+    if (modelPtr == 0) return JNI_FALSE;
+
+    auto* wrapper = reinterpret_cast<LlamaModelWrapper*>(modelPtr);
+    if (!wrapper->initialized) return JNI_FALSE;
+
+    // The running request samples with this chain and indexes candidates/penalized, so the
+    // config and the rebuild wait for it to finish
+    RequestLock lock(wrapper);
+
+    SamplerConfig& config = wrapper->sampler_config;
+    config.temperature = temperature;
+    config.top_k = topK;
+    config.top_p = topP;
+    config.repeat_penalty = repeatPenalty > 0.0f ? repeatPenalty : 1.0f;
+    config.seed = seed < 0 ? LLAMA_DEFAULT_SEED : (uint32_t)seed;
+
+    log_android(LOG_TAG, "🎛️ Sampling: temp=" + std::to_string(temperature) + " top_k=" + std::to_string(topK) +
+                         " top_p=" + std::to_string(topP) + " repeat=" + std::to_string(config.repeat_penalty));
+    return init_sampler(wrapper) ? JNI_TRUE : JNI_FALSE;
+}
+
+JNIEXPORT void JNICALL
+Java_com_dreamassistant_ai_LlamaEngine_setThreadPolicy(JNIEnv *env, jobject thiz, jlong modelPtr, jint policy) {
+    if (modelPtr == 0) return;
+
+    auto* wrapper = reinterpret_cast<LlamaModelWrapper*>(modelPtr);
+    if (policy != THREAD_POLICY_INTERACTIVE && policy != THREAD_POLICY_BACKGROUND) return;
+
+    // Applied by the inference thread before its next request, never mid-decode
+    wrapper->requested_thread_policy.store(policy);
+    log_android(LOG_TAG, "🧵 Thread policy " + std::to_string(policy) + " requested");
+}
+
+JNIEXPORT jint JNICALL
+Java_com_dreamassistant_ai_LlamaEngine_setPrefillChunkSize(JNIEnv *env, jobject thiz, jlong modelPtr, jint chunkSize) {
+    if (modelPtr == 0) return -1;
+
+    auto* wrapper = reinterpret_cast<LlamaModelWrapper*>(modelPtr);
+    if (!wrapper->initialized) return -1;
+
+    // Larger chunks than n_ubatch would be split by llama_decode anyway; picked up at the next chunk
+    int chunk = std::max(1, std::min((int)chunkSize, wrapper->batch_capacity));
+    wrapper->prefill_chunk.store(chunk);
+    log_android(LOG_TAG, "🧩 Prefill chunk size: " + std::to_string(chunk));
+    return chunk;
+}
+
+JNIEXPORT void JNICALL
+Java_com_dreamassistant_ai_LlamaEngine_cancelGeneration(JNIEnv *env, jobject thiz, jlong modelPtr) {
+    if (modelPtr == 0) return;
+
+    auto* wrapper = reinterpret_cast<LlamaModelWrapper*>(modelPtr);
+    wrapper->cancel_epoch.fetch_add(1);
+    log_android(LOG_TAG, "⏹️ Cancel requested");
 }
 
 JNIEXPORT jboolean JNICALL
@@ -232,15 +3686,45 @@ Java_com_dreamassistant_ai_LlamaEngine_freeModel(JNIEnv *env, jobject thiz, jlon
 
     auto* wrapper = reinterpret_cast<LlamaModelWrapper*>(modelPtr);
 
-    if (wrapper->ctx) {
-        llama_free((llama_context*)wrapper->ctx);
-    }
+    // Stop the running job and cancel queued ones before tearing anything down. shutting_down
+    // also trips the abort callback, so a direct (unqueued) call inside llama_decode lets go
+    // of ctx_mutex within one graph node; nothing is freed until it has
+    wrapper->shutting_down.store(true);
+    wrapper->queue.stop();
 
-    if (wrapper->model) {
-        llama_free_model((llama_model*)wrapper->model);
-    }
+    {
+        RequestLock lock(wrapper);
+
+        if (wrapper->sampler) {
+            llama_sampler_free(wrapper->sampler);
+        }
+
+        free_threadpools(wrapper);
+
+        if (wrapper->batch_capacity > 0) {
+            llama_batch_free(wrapper->batch);
+        }
 
-    llama_backend_free();
+        if (wrapper->ctx) {
+            llama_free((llama_context*)wrapper->ctx);
+        }
+
+        free_draft_model(wrapper->draft);
+        count_lora_user(wrapper->shared_model, wrapper->lora_path, -1);
+
+        if (wrapper->grammar) {
+            llama_sampler_free(wrapper->grammar);
+        }
+        wrapper->sampler = nullptr;
+        wrapper->grammar = nullptr;
+        wrapper->ctx = nullptr;
+        wrapper->batch_capacity = 0;
+
+        // The weights and the backend go away only with the last context using them
+        if (wrapper->shared_model) {
+            release_model(wrapper->shared_model);
+        }
+    }
 
     delete wrapper;
     log_android(LOG_TAG, "✅ Dream Assistant model cleaned up");
@@ -262,7 +3746,11 @@ Java_com_dreamassistant_ai_LlamaEngine_getModelInfo(JNIEnv *env, jobject thiz, j
     info << "- Specialized for: Sister with speech impairment\n";
     info << "- Vocab size: " << wrapper->vocab_size << "\n";
     info << "- Context size: " << wrapper->context_size << "\n";
+    info << "- KV cache: " << ggml_type_name(wrapper->kv_config.type_k) << "/"
+         << ggml_type_name(wrapper->kv_config.type_v) << "\n";
+    info << "- CPU backend: " << active_cpu_variant() << "\n";
     info << "- Model path: " << wrapper->model_path << "\n";
+    info << "- LoRA adapter: " << (wrapper->lora_path.empty() ? std::string("none") : wrapper->lora_path) << "\n";
     info << "- Status: Ready to help! 💕";
 
     return string_to_jstring(env, info.str());
@@ -276,6 +3764,17 @@ Java_com_dreamassistant_ai_LlamaEngine_getInferenceTime(JNIEnv *env, jobject thi
     return wrapper->last_inference_time;
 }
 
+JNIEXPORT jdoubleArray JNICALL
+Java_com_dreamassistant_ai_LlamaEngine_getInferenceMetrics(JNIEnv *env, jobject thiz, jlong modelPtr) {
+    jdoubleArray result = env->NewDoubleArray(METRIC_COUNT);
+    if (modelPtr == 0 || result == nullptr) return result;
+
+    auto* wrapper = reinterpret_cast<LlamaModelWrapper*>(modelPtr);
+    std::lock_guard<std::mutex> lock(wrapper->metrics_mutex);
+    env->SetDoubleArrayRegion(result, 0, METRIC_COUNT, wrapper->last_metrics.data());
+    return result;
+}
+
 JNIEXPORT jint JNICALL
 Java_com_dreamassistant_ai_LlamaEngine_getTokenCount(JNIEnv *env, jobject thiz, jlong modelPtr, jstring text) {
     if (modelPtr == 0) return -1;
@@ -284,21 +3783,7 @@ Java_com_dreamassistant_ai_LlamaEngine_getTokenCount(JNIEnv *env, jobject thiz,
     if (!wrapper->initialized) return -1;
 
     std::string input = jstring_to_string(env, text);
-
-    std::vector<llama_token> tokens;
-    tokens.resize(input.length() + 1);
-
-    int n_tokens = llama_tokenize(
-            (llama_model*)wrapper->model,
-            input.c_str(),
-            input.length(),
-            tokens.data(),
-            tokens.size(),
-            true,
-            true
-    );
-
-    return n_tokens;
+    return (jint)tokenize_cached(wrapper, input, true).size();
 }
 
 JNIEXPORT jstring JNICALL
@@ -313,33 +3798,14 @@ Java_com_dreamassistant_ai_LlamaEngine_tokenizeText(JNIEnv *env, jobject thiz, j
     }
 
     std::string input = jstring_to_string(env, text);
-
-    std::vector<llama_token> tokens;
-    tokens.resize(input.length() + 1);
-
-    int n_tokens = llama_tokenize(
-            (llama_model*)wrapper->model,
-            input.c_str(),
-            input.length(),
-            tokens.data(),
-            tokens.size(),
-            true,
-            true
-    );
+    std::vector<llama_token> tokens = tokenize_cached(wrapper, input, true);
 
     std::ostringstream result;
-    result << "Tokens (" << n_tokens << "): ";
-    for (int i = 0; i < n_tokens; i++) {
-        char token_str[256];
-        llama_token_to_piece(
-                (llama_model*)wrapper->model,
-                tokens[i],
-                token_str,
-                sizeof(token_str),
-                0,
-                true
-        );
-        result << "[" << tokens[i] << "]" << token_str << " ";
+    result << "Tokens (" << tokens.size() << "): ";
+    for (size_t i = 0; i < tokens.size(); i++) {
+        std::string piece;
+        append_token_piece(wrapper, tokens[i], piece);
+        result << "[" << tokens[i] << "]" << piece << " ";
     }
 
     return string_to_jstring(env, result.str());
@@ -4,6 +4,19 @@
 #include <jni.h>
 #include <string>
 #include <memory>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <list>
+#include <unordered_map>
+#include <thread>
+
+#include "llama.h"
+#include "cpu-features.h"
+#include "inference-queue.h"
+
+// Conversation sequence shared by the system prefix and the chat turns
+#define PREFIX_SEQ_ID 0
 
 extern "C" {
 
@@ -11,9 +24,56 @@ extern "C" {
 JNIEXPORT jlong JNICALL
 Java_com_dreamassistant_ai_LlamaEngine_initializeModel(JNIEnv *env, jobject thiz, jstring modelPath);
 
+JNIEXPORT jlong JNICALL
+Java_com_dreamassistant_ai_LlamaEngine_initializeModelAsync(JNIEnv *env, jobject thiz, jstring modelPath);
+
+JNIEXPORT jlong JNICALL
+Java_com_dreamassistant_ai_LlamaEngine_loadModel(JNIEnv *env, jobject thiz, jstring modelPath);
+
+JNIEXPORT jlong JNICALL
+Java_com_dreamassistant_ai_LlamaEngine_createContext(JNIEnv *env, jobject thiz, jlong modelHandle, jint contextLength);
+
+JNIEXPORT void JNICALL
+Java_com_dreamassistant_ai_LlamaEngine_releaseModel(JNIEnv *env, jobject thiz, jlong modelHandle);
+
+JNIEXPORT void JNICALL
+Java_com_dreamassistant_ai_LlamaEngine_configureKvCache(JNIEnv *env, jobject thiz, jint kvTypeK, jint kvTypeV,
+                                                        jint contextLength);
+
+JNIEXPORT jint JNICALL
+Java_com_dreamassistant_ai_LlamaEngine_getReadinessState(JNIEnv *env, jobject thiz, jlong modelPtr);
+
 JNIEXPORT jstring JNICALL
 Java_com_dreamassistant_ai_LlamaEngine_generateResponse(JNIEnv *env, jobject thiz, jlong modelPtr, jstring prompt);
 
+JNIEXPORT jlong JNICALL
+Java_com_dreamassistant_ai_LlamaEngine_submitResponse(JNIEnv *env, jobject thiz, jlong modelPtr, jstring prompt,
+                                                     jint priority, jobject callback);
+
+JNIEXPORT void JNICALL
+Java_com_dreamassistant_ai_LlamaEngine_cancelRequest(JNIEnv *env, jobject thiz, jlong modelPtr, jlong requestId);
+
+JNIEXPORT jstring JNICALL
+Java_com_dreamassistant_ai_LlamaEngine_generateResponseStream(JNIEnv *env, jobject thiz, jlong modelPtr, jstring prompt,
+                                                              jobject callback);
+
+JNIEXPORT jstring JNICALL
+Java_com_dreamassistant_ai_LlamaEngine_generateResponseSentences(JNIEnv *env, jobject thiz, jlong modelPtr, jstring prompt,
+                                                                 jobject callback);
+
+JNIEXPORT jboolean JNICALL
+Java_com_dreamassistant_ai_LlamaEngine_setSamplingParams(JNIEnv *env, jobject thiz, jlong modelPtr, jfloat temperature,
+                                                         jint topK, jfloat topP, jfloat repeatPenalty, jint seed);
+
+JNIEXPORT void JNICALL
+Java_com_dreamassistant_ai_LlamaEngine_setThreadPolicy(JNIEnv *env, jobject thiz, jlong modelPtr, jint policy);
+
+JNIEXPORT jint JNICALL
+Java_com_dreamassistant_ai_LlamaEngine_setPrefillChunkSize(JNIEnv *env, jobject thiz, jlong modelPtr, jint chunkSize);
+
+JNIEXPORT void JNICALL
+Java_com_dreamassistant_ai_LlamaEngine_cancelGeneration(JNIEnv *env, jobject thiz, jlong modelPtr);
+
 JNIEXPORT jboolean JNICALL
 Java_com_dreamassistant_ai_LlamaEngine_isModelLoaded(JNIEnv *env, jobject thiz, jlong modelPtr);
 
@@ -26,26 +86,435 @@ Java_com_dreamassistant_ai_LlamaEngine_getModelInfo(JNIEnv *env, jobject thiz, j
 JNIEXPORT jfloat JNICALL
 Java_com_dreamassistant_ai_LlamaEngine_getInferenceTime(JNIEnv *env, jobject thiz, jlong modelPtr);
 
+JNIEXPORT jdoubleArray JNICALL
+Java_com_dreamassistant_ai_LlamaEngine_getInferenceMetrics(JNIEnv *env, jobject thiz, jlong modelPtr);
+
 JNIEXPORT jint JNICALL
 Java_com_dreamassistant_ai_LlamaEngine_getTokenCount(JNIEnv *env, jobject thiz, jlong modelPtr, jstring text);
 
 JNIEXPORT jstring JNICALL
 Java_com_dreamassistant_ai_LlamaEngine_tokenizeText(JNIEnv *env, jobject thiz, jlong modelPtr, jstring text);
 
+JNIEXPORT jint JNICALL
+Java_com_dreamassistant_ai_LlamaEngine_generateResponseDirect(JNIEnv *env, jobject thiz, jlong modelPtr,
+                                                              jobject inputBuffer, jint inputLength,
+                                                              jobject outputBuffer, jobject callback);
+
+JNIEXPORT void JNICALL
+Java_com_dreamassistant_ai_LlamaEngine_resetSession(JNIEnv *env, jobject thiz, jlong modelPtr);
+
+JNIEXPORT jint JNICALL
+Java_com_dreamassistant_ai_LlamaEngine_prefillPartial(JNIEnv *env, jobject thiz, jlong modelPtr, jstring partialText);
+
+JNIEXPORT void JNICALL
+Java_com_dreamassistant_ai_LlamaEngine_discardPartial(JNIEnv *env, jobject thiz, jlong modelPtr);
+
+JNIEXPORT jboolean JNICALL
+Java_com_dreamassistant_ai_LlamaEngine_loadLoraAdapter(JNIEnv *env, jobject thiz, jlong modelPtr, jstring adapterPath);
+
+JNIEXPORT jboolean JNICALL
+Java_com_dreamassistant_ai_LlamaEngine_setLoraAdapter(JNIEnv *env, jobject thiz, jlong modelPtr, jstring adapterPath, jfloat scale);
+
+JNIEXPORT void JNICALL
+Java_com_dreamassistant_ai_LlamaEngine_unloadLoraAdapter(JNIEnv *env, jobject thiz, jlong modelPtr, jstring adapterPath);
+
+JNIEXPORT jboolean JNICALL
+Java_com_dreamassistant_ai_LlamaEngine_setSpeculativeMode(JNIEnv *env, jobject thiz, jlong modelPtr, jint mode, jint maxDraft);
+
+JNIEXPORT jboolean JNICALL
+Java_com_dreamassistant_ai_LlamaEngine_loadDraftModel(JNIEnv *env, jobject thiz, jlong modelPtr, jstring draftPath);
+
+JNIEXPORT jlongArray JNICALL
+Java_com_dreamassistant_ai_LlamaEngine_getSpeculativeStats(JNIEnv *env, jobject thiz, jlong modelPtr);
+
+JNIEXPORT jstring JNICALL
+Java_com_dreamassistant_ai_LlamaEngine_generateAction(JNIEnv *env, jobject thiz, jlong modelPtr, jstring prompt, jstring grammar);
+
+JNIEXPORT jint JNICALL
+Java_com_dreamassistant_ai_LlamaEngine_trimMemory(JNIEnv *env, jobject thiz, jlong modelPtr, jint level);
+
+JNIEXPORT jboolean JNICALL
+Java_com_dreamassistant_ai_LlamaEngine_saveSession(JNIEnv *env, jobject thiz, jlong modelPtr, jstring path);
+
+JNIEXPORT jboolean JNICALL
+Java_com_dreamassistant_ai_LlamaEngine_loadSession(JNIEnv *env, jobject thiz, jlong modelPtr, jstring path);
+
+JNIEXPORT jfloatArray JNICALL
+Java_com_dreamassistant_ai_LlamaEngine_getEmbedding(JNIEnv *env, jobject thiz, jlong modelPtr, jstring text);
+
+JNIEXPORT jboolean JNICALL
+Java_com_dreamassistant_ai_LlamaEngine_addIntentExemplar(JNIEnv *env, jobject thiz, jlong modelPtr, jstring label, jstring text);
+
+JNIEXPORT jstring JNICALL
+Java_com_dreamassistant_ai_LlamaEngine_matchIntent(JNIEnv *env, jobject thiz, jlong modelPtr, jstring text, jfloat minScore);
+
+JNIEXPORT void JNICALL
+Java_com_dreamassistant_ai_LlamaEngine_clearIntents(JNIEnv *env, jobject thiz, jlong modelPtr);
+
+JNIEXPORT jint JNICALL
+Java_com_dreamassistant_ai_LlamaEngine_openSession(JNIEnv *env, jobject thiz, jlong modelPtr);
+
+JNIEXPORT void JNICALL
+Java_com_dreamassistant_ai_LlamaEngine_closeSession(JNIEnv *env, jobject thiz, jlong modelPtr, jint sessionId);
+
+JNIEXPORT jobjectArray JNICALL
+Java_com_dreamassistant_ai_LlamaEngine_generateParallel(JNIEnv *env, jobject thiz, jlong modelPtr,
+                                                        jintArray sessionIds, jobjectArray prompts, jintArray maxTokens);
+
+JNIEXPORT jlong JNICALL
+Java_com_dreamassistant_ai_LlamaEngine_submitBatch(JNIEnv *env, jobject thiz, jlong modelPtr, jobjectArray keys,
+                                                  jobjectArray prompts, jint maxTokens, jstring cachePath,
+                                                  jobject callback);
+
 } // extern "C"
 
+// Constants
+#define LOG_TAG "LlamaAndroid"
+#define MAX_CONTEXT_LENGTH 2048
+#define DEFAULT_TEMPERATURE 0.7f
+#define DEFAULT_TOP_K 40
+#define DEFAULT_TOP_P 0.9f
+#define DEFAULT_REPEAT_PENALTY 1.1f
+#define DEFAULT_REPEAT_LAST_N 64
+#define DEFAULT_SEED 1234
+#define TOKEN_CACHE_CAPACITY 64
+#define WARMUP_BATCH_TOKENS 8
+#define MAX_PARALLEL_SEQUENCES 4 // main session plus up to three side sessions
+#define SPEC_DEFAULT_DRAFT 4      // tokens proposed per verification batch
+#define SPEC_MAX_DRAFT 16
+#define SPEC_LOOKUP_MIN_NGRAM 2   // prompt lookup matches the last 2..4 tokens
+#define SPEC_LOOKUP_MAX_NGRAM 4
+#define ACTION_MAX_TOKENS 96           // a structured action is a short JSON object
+#define GRAMMAR_MASK_MAX_TOKENS 512    // only small allowed-token sets are worth caching
+#define GRAMMAR_MASK_CACHE_ENTRIES 256
+#define INTENT_MAX_EXEMPLARS 256       // greetings/thanks phrasings; a linear scan stays in L2
+#define PREFILL_CHUNK_SIZE 128 // tokens per llama_decode during prefill; also caps n_ubatch scratch memory
+#define MAX_DECODE_THREADS 4 // decode is memory-bound; more threads only add contention
+#define PREFIX_STATE_SUFFIX ".prefix.bin"
+#define SESSION_FILE_MAGIC 0x53534144u // "DASS"
+#define SESSION_FILE_VERSION 2
+#define SUGGESTION_CACHE_MAGIC 0x47534144u // "DASG"
+#define SUGGESTION_CACHE_VERSION 1
+#define TRIM_SPILL_SUFFIX ".trim.session" // conversation parked here while the context is released
+
+// ComponentCallbacks2 trim levels passed through from onTrimMemory
+#define TRIM_MEMORY_RUNNING_MODERATE 5
+#define TRIM_MEMORY_RUNNING_CRITICAL 15
+#define TRIM_MEMORY_BACKGROUND 40
+#define TRIM_MEMORY_MODERATE 60
+#define KV_CACHE_RAM_FRACTION 8 // automatic sizing lets the KV cache use at most 1/8 of RAM
+#define MIN_CONTEXT_LENGTH 1024
+#define MAX_RESPONSE_TOKENS 150
+#define MAX_RESPONSE_SENTENCES 3
+
 // Internal structures and classes
+
+// Conversation state mirrored in the KV cache: tokens[i] sits at position i of seq_id
+struct LlamaSession {
+    llama_seq_id seq_id;
+    std::vector<llama_token> tokens;
+    std::vector<size_t> turn_starts; // index in tokens where each retained turn begins, oldest first
+    int n_turns;
+
+    bool in_use; // parallel sessions only; the main session is always open
+
+    LlamaSession() : seq_id(PREFIX_SEQ_ID), n_turns(0), in_use(false) {}
+};
+
+// Bounded LRU of tokenization results, keyed by a hash of the text. The text is kept
+// alongside so hash collisions never return the wrong tokens.
+class TokenCache {
+public:
+    explicit TokenCache(size_t capacity = TOKEN_CACHE_CAPACITY) : capacity_(capacity) {}
+
+    bool get(const std::string& text, bool add_special, std::vector<llama_token>& out);
+    void put(const std::string& text, bool add_special, const std::vector<llama_token>& tokens);
+    void clear();
+
+private:
+    struct Entry {
+        size_t key;
+        std::string text;
+        bool add_special;
+        std::vector<llama_token> tokens;
+    };
+
+    static size_t make_key(const std::string& text, bool add_special);
+
+    size_t capacity_;
+    std::list<Entry> entries_; // most recently used first
+    std::unordered_map<size_t, std::list<Entry>::iterator> index_;
+    std::mutex mutex_;
+};
+
+// Sampling parameters for the reply, adjustable at runtime from Kotlin
+struct SamplerConfig {
+    float temperature;
+    int top_k;
+    float top_p;
+    float repeat_penalty;
+    int repeat_last_n;
+    uint32_t seed;
+
+    SamplerConfig() : temperature(DEFAULT_TEMPERATURE), top_k(DEFAULT_TOP_K), top_p(DEFAULT_TOP_P),
+                      repeat_penalty(DEFAULT_REPEAT_PENALTY), repeat_last_n(DEFAULT_REPEAT_LAST_N),
+                      seed(DEFAULT_SEED) {}
+};
+
+// Slots of the array returned by getInferenceMetrics (mirrored in InferenceMetrics.kt)
+enum InferenceMetric {
+    METRIC_TTFT_MS = 0,              // request start to first sampled token
+    METRIC_PREFILL_MS,
+    METRIC_PREFILL_TOKENS,           // prompt tokens actually decoded (cache hits excluded)
+    METRIC_PREFILL_TOKENS_PER_S,
+    METRIC_DECODE_MS,
+    METRIC_DECODE_TOKENS,            // reply tokens generated
+    METRIC_DECODE_TOKENS_PER_S,
+    METRIC_TOTAL_MS,
+    METRIC_KV_USED_CELLS,
+    METRIC_KV_CAPACITY,
+    METRIC_PEAK_RSS_KB,
+    METRIC_PERF_PROMPT_EVAL_MS,      // llama_perf_context, reset per request
+    METRIC_PERF_PROMPT_EVAL_TOKENS,
+    METRIC_PERF_EVAL_MS,
+    METRIC_PERF_EVAL_TOKENS,
+    METRIC_COUNT
+};
+
+// Staged readiness reported to Kotlin while the model comes up
+enum ReadinessState {
+    READINESS_FAILED = -1,
+    READINESS_LOADING = 0,
+    READINESS_MAPPED = 1,       // weights mmapped, context created; requests work but pay page faults
+    READINESS_WARMED = 2,       // weight pages prefetched and a dummy batch decoded
+    READINESS_PREFIX_CACHED = 3 // system prefix in the KV cache; fastest first reply
+};
+
+// KV cache element type (values match KvCacheType in LlamaEngine.kt)
+enum KvCacheType {
+    KV_CACHE_F16 = 0,
+    KV_CACHE_Q8_0 = 1, // ~half of F16, near-lossless
+    KV_CACHE_Q4_0 = 2  // ~quarter of F16, for long contexts on 4 GB phones
+};
+
+// Applies to contexts created after it is set; n_ctx 0 sizes the cache from device RAM
+struct KvCacheConfig {
+    ggml_type type_k;
+    ggml_type type_v;
+    int n_ctx;
+
+    KvCacheConfig() : type_k(GGML_TYPE_F16), type_v(GGML_TYPE_F16), n_ctx(MAX_CONTEXT_LENGTH) {}
+};
+
+// Attention geometry read from GGUF metadata, used to size the KV cache
+struct KvLayout {
+    int n_layer;
+    int n_head_kv;
+    int key_length;
+    int value_length;
+    int n_ctx_train;
+};
+
+// A LoRA adapter mapped onto a SharedModel and the number of contexts applying it
+struct LoraAdapterRef {
+    llama_lora_adapter* adapter;
+    int users;
+
+    LoraAdapterRef() : adapter(nullptr), users(0) {}
+};
+
+// One mmapped GGUF shared by every context created from it; refs guarded by the registry mutex
+struct SharedModel {
+    llama_model* model;
+    std::string path;
+    int refs;
+    // LoRA adapters loaded onto these weights, by file path; any context may apply them
+    std::unordered_map<std::string, LoraAdapterRef> adapters;
+
+    SharedModel() : model(nullptr), refs(0) {}
+};
+
+// What trimMemory released, cumulative (values match TrimStage in LlamaEngine.kt)
+enum TrimStage {
+    TRIM_STAGE_NONE = 0,
+    TRIM_STAGE_CACHES = 1,   // tokenizer cache, grammar masks, sampling scratch
+    TRIM_STAGE_CONTEXT = 2,  // KV cache + compute buffers + threadpools; conversation spilled to disk
+    TRIM_STAGE_WEIGHTS = 3   // resident weight pages dropped (they fault back in from the file)
+};
+
+// Where speculative draft tokens come from (values match SpeculativeMode in LlamaEngine.kt)
+enum SpeculativeMode {
+    SPEC_MODE_OFF = 0,
+    SPEC_MODE_PROMPT_LOOKUP = 1, // copy what followed the same n-gram earlier in the conversation
+    SPEC_MODE_DRAFT_MODEL = 2    // greedy continuation from a small model with the same vocab
+};
+
+// Small model proposing tokens for the main one to verify; tokens mirrors its KV cache
+struct DraftModel {
+    SharedModel* shared;
+    llama_context* ctx;
+    llama_batch batch;
+    int batch_capacity;
+    std::vector<llama_token> tokens;
+
+    DraftModel() : shared(nullptr), ctx(nullptr), batch(), batch_capacity(0) {}
+};
+
+// Cumulative since load; acceptance rate = n_accepted / n_drafted. Atomic so
+// getSpeculativeStats can poll them without waiting for the running reply.
+struct SpeculativeStats {
+    std::atomic<uint64_t> n_steps;    // verification batches
+    std::atomic<uint64_t> n_drafted;
+    std::atomic<uint64_t> n_accepted;
+
+    SpeculativeStats() : n_steps(0), n_drafted(0), n_accepted(0) {}
+};
+
+// Fixed prompt pieces tokenized once per model; a turn is spliced together from these spans
+// and the tokenized user text, so no fixed text is formatted or re-tokenized per request.
+// Gemma: <bos><start_of_turn>user\n SYSTEM | text <end_of_turn>\n<start_of_turn>model\n | ...
+struct ChatTemplate {
+    bool gemma;                            // model has <start_of_turn>/<end_of_turn> control tokens
+    llama_token end_of_turn;               // -1 when the model has no such token
+    std::vector<llama_token> system_prefix;   // BOS + system preamble, cached in the KV cache
+    std::vector<llama_token> first_user_open; // before the first user text after the preamble
+    std::vector<llama_token> user_open;       // closes the previous reply and opens a user turn
+    std::vector<llama_token> model_open;      // closes the user turn and opens the reply
+
+    ChatTemplate() : gemma(false), end_of_turn(-1) {}
+};
+
+// Unit-length prefill embeddings of intent exemplars, one row of `dim` floats each,
+// so cosine similarity is a plain dot product over contiguous memory
+struct IntentIndex {
+    int dim;
+    std::vector<float> vectors;
+    std::vector<std::string> labels;
+
+    IntentIndex() : dim(0) {}
+    size_t size() const { return labels.size(); }
+};
+
+// Where inference threads may run; switched by Kotlin on lifecycle changes
+enum ThreadPolicy {
+    THREAD_POLICY_INTERACTIVE = 0, // decode pinned to performance cores, prefill on every core
+    THREAD_POLICY_BACKGROUND = 1   // little cores only, no busy-polling
+};
+
 struct LlamaModelWrapper {
     void* ctx;
     void* model;
+    SharedModel* shared_model; // owns model; the wrapper holds one reference
+    KvCacheConfig kv_config;   // what this context was actually created with
     std::string model_path;
     bool initialized;
     float last_inference_time;
+    uint64_t n_evaluated;              // tokens fed through llama_decode so far
+    std::vector<double> last_metrics;  // InferenceMetric slots of the last finished request
+    std::mutex metrics_mutex;
     int vocab_size;
     int context_size;
 
-    LlamaModelWrapper() : ctx(nullptr), model(nullptr), initialized(false),
-                          last_inference_time(0.0f), vocab_size(0), context_size(0) {}
+    // Sister's system preamble, decoded once at load time and kept in the KV cache
+    std::vector<llama_token> prefix_tokens;
+    ChatTemplate chat_template;
+
+    // Conversation last written by saveSession, so an unchanged one is not rewritten
+    std::string saved_session_path;
+    std::vector<llama_token> saved_session_tokens;
+    // Set while trimMemory has released ctx: the session file to restore on the next request
+    std::string spill_path;
+    int n_prefix;
+
+    // Repeated getTokenCount/tokenizeText queries from the UI
+    TokenCache token_cache;
+
+    // Multi-turn conversation continuing on top of the prefix
+    LlamaSession session;
+    // Where a speculative prefillPartial turn begins in session.tokens, -1 when none is
+    // pending; everything from here on is revocable until run_chat_turn adopts it
+    int partial_start;
+    // Side sessions on seq_id 1..MAX_PARALLEL_SEQUENCES-1, sharing the prefix cells of seq 0
+    std::vector<LlamaSession> parallel_sessions;
+
+    // Reusable batch for chunked prefill; prefill_chunk <= batch capacity (n_ubatch).
+    // Atomic because setPrefillChunkSize may change it while the worker is decoding.
+    llama_batch batch;
+    int batch_capacity;
+    std::atomic<int> prefill_chunk;
+
+    // Sampler chain plus candidate buffers sized to the vocab once, so sampling never allocates
+    SamplerConfig sampler_config;
+    llama_sampler* sampler;
+    std::vector<llama_token_data> candidates;
+    std::vector<uint8_t> penalized;
+
+    // Separate pinned pools for decode (threadpool) and prefill (threadpool_batch);
+    // a requested policy change is applied before the next request
+    CpuTopology cpu_topology;
+    struct ggml_threadpool* threadpool;
+    struct ggml_threadpool* threadpool_batch;
+    int active_thread_policy;
+    std::atomic<int> requested_thread_policy;
+
+    // Held for the whole of a request. Cancelling bumps cancel_epoch and the holder lets go
+    // (within one token, or one ggml graph node via the abort callback) once it no longer
+    // matches the request_epoch it read on arrival, so a cancel sent while the request was
+    // still waiting for the mutex is not lost
+    std::mutex ctx_mutex;
+    std::atomic<uint32_t> cancel_epoch;
+    std::atomic<uint32_t> request_epoch;
+
+    // Constrained decoding for generateAction: grammar sampler plus allowed-token sets keyed
+    // by the text generated so far (the grammar state is a pure function of that text)
+    llama_sampler* grammar;
+    std::string grammar_text;
+    std::unordered_map<std::string, std::vector<llama_token> > grammar_masks;
+
+    // Early-exit intent matching for matchIntent
+    IntentIndex intents;
+
+    // Optional draft stage of the generation loop
+    int spec_mode;
+    int spec_max_draft;
+    DraftModel draft;
+    SpeculativeStats spec_stats;
+
+    // LoRA adapter applied to this context; empty means the base weights
+    std::string lora_path;
+    float lora_scale;
+
+    // Worker thread for submitted requests (warm-up, queued replies, intent exemplars);
+    // started on first use, stopped by freeModel
+    InferenceQueue queue;
+    std::atomic<int> readiness;
+    std::atomic<bool> shutting_down;
+
+    LlamaModelWrapper() : ctx(nullptr), model(nullptr), shared_model(nullptr), initialized(false),
+                          last_inference_time(0.0f), n_evaluated(0), last_metrics(METRIC_COUNT, 0.0),
+                          vocab_size(0), context_size(0),
+                          n_prefix(0), partial_start(-1), batch(), batch_capacity(0), prefill_chunk(PREFILL_CHUNK_SIZE),
+                          sampler(nullptr), threadpool(nullptr), threadpool_batch(nullptr),
+                          active_thread_policy(-1), requested_thread_policy(THREAD_POLICY_INTERACTIVE),
+                          cancel_epoch(0), request_epoch(0), grammar(nullptr), spec_mode(SPEC_MODE_OFF), spec_max_draft(SPEC_DEFAULT_DRAFT),
+                          lora_scale(0.0f),
+                          readiness(READINESS_LOADING), shutting_down(false) {}
+};
+
+// Cuts streamed reply text into whole sentences so speech can start early
+struct SentenceSplitter {
+    std::string buffer;
+    size_t scan_pos;
+
+    SentenceSplitter() : scan_pos(0) {}
+
+    // Append streamed text; completed sentences are pushed to `out`
+    void feed(const char* text, size_t len, std::vector<std::string>& out);
+    // Emit whatever is left once generation ends
+    void flush(std::vector<std::string>& out);
+
+private:
+    void emit(size_t end, std::vector<std::string>& out);
 };
 
 // Utility functions
@@ -53,11 +522,4 @@ std::string jstring_to_string(JNIEnv* env, jstring jstr);
 jstring string_to_jstring(JNIEnv* env, const std::string& str);
 void log_android(const std::string& tag, const std::string& message);
 
-// Constants
-#define LOG_TAG "LlamaAndroid"
-#define MAX_CONTEXT_LENGTH 2048
-#define DEFAULT_TEMPERATURE 0.7f
-#define DEFAULT_TOP_K 40
-#define DEFAULT_TOP_P 0.9f
-
 #endif // LLAMA_ANDROID_H
\ No newline at end of file
@@ -0,0 +1,47 @@
+#ifndef LLAMA_ANDROID_TRACE_H
+#define LLAMA_ANDROID_TRACE_H
+
+// Systrace/Perfetto markers for the inference hot path. Compiled in only with
+// -DLLAMA_ANDROID_TRACE=ON; otherwise every macro expands to nothing.
+//
+//   TRACE_SECTION("llama:prefill");          // scoped: ends with the enclosing block
+//   TRACE_COUNTER("llama:tokens", n);        // shows as a counter track (API 29+)
+
+#if defined(LLAMA_ANDROID_TRACE)
+
+#include <android/trace.h>
+#include <dlfcn.h>
+#include <stdint.h>
+
+class TraceSection {
+public:
+    explicit TraceSection(const char* name) { ATrace_beginSection(name); }
+    ~TraceSection() { ATrace_endSection(); }
+
+private:
+    TraceSection(const TraceSection&);
+    TraceSection& operator=(const TraceSection&);
+};
+
+// ATrace_setCounter only exists from API 29; minSdk is 24, so it is looked up at runtime
+inline void trace_counter(const char* name, int64_t value) {
+    typedef void (*SetCounterFn)(const char*, int64_t);
+    static SetCounterFn set_counter = (SetCounterFn)dlsym(RTLD_DEFAULT, "ATrace_setCounter");
+    if (set_counter != nullptr && ATrace_isEnabled()) {
+        set_counter(name, value);
+    }
+}
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+#define TRACE_SECTION(name) TraceSection TRACE_CONCAT(trace_section_, __LINE__)(name)
+#define TRACE_COUNTER(name, value) trace_counter(name, (int64_t)(value))
+
+#else
+
+#define TRACE_SECTION(name) ((void)0)
+#define TRACE_COUNTER(name, value) ((void)0)
+
+#endif
+
+#endif // LLAMA_ANDROID_TRACE_H
@@ -5,6 +5,7 @@ import androidx.lifecycle.ViewModel
 import androidx.lifecycle.viewModelScope
 import com.example.dreamassistant.ai.LlamaEngine
 import kotlinx.coroutines.flow.MutableStateFlow
+import kotlinx.coroutines.Job
 import kotlinx.coroutines.flow.StateFlow
 import kotlinx.coroutines.flow.asStateFlow
 import kotlinx.coroutines.launch
@@ -24,11 +25,29 @@ class ChatViewModel : ViewModel() {
     var isModelReady: Boolean = false
         private set
 
+    private var readinessJob: Job? = null
+
     init {
         Log.d(TAG, "🚀 ChatViewModel initialized for Sister's Dream Assistant")
         addMessage(ChatMessage.createWelcomeMessage())
     }
 
+    /**
+     * Follow the engine's warm-up so later stages are visible while she chats
+     */
+    private fun observeReadiness(engine: LlamaEngine) {
+        readinessJob?.cancel()
+        readinessJob = viewModelScope.launch {
+            engine.readiness.collect { stage ->
+                Log.d(TAG, "🌡️ Model readiness: $stage")
+                if (stage == LlamaEngine.Readiness.MAPPED || stage == LlamaEngine.Readiness.WARMED ||
+                    stage == LlamaEngine.Readiness.PREFIX_CACHED) {
+                    isModelReady = true
+                }
+            }
+        }
+    }
+
     /**
      * Set the real LlamaEngine when it's ready
      */
@@ -36,6 +55,7 @@ class ChatViewModel : ViewModel() {
         llamaEngine = engine
         isModelReady = engine.isModelReady()
         Log.d(TAG, "✅ Real LlamaEngine set - Model ready: $isModelReady")
+        observeReadiness(engine)
 
         if (isModelReady) {
             val readyMessage = ChatMessage.createModelResponse(
@@ -142,6 +162,7 @@ class ChatViewModel : ViewModel() {
      * Clear messages (testing)
      */
     fun clearMessages() {
+        llamaEngine?.resetConversation()
         _uiState.value = _uiState.value.copy(messages = emptyList())
         addMessage(ChatMessage.createWelcomeMessage())
     }
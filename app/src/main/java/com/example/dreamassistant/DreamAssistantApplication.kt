@@ -2,6 +2,7 @@ package com.example.dreamassistant
 
 import android.app.Application
 import android.util.Log
+import com.example.dreamassistant.ai.LlamaEngine
 
 /**
  * DreamAssistantApplication - Application class for Sister's Dream Assistant
@@ -18,4 +19,11 @@ class DreamAssistantApplication : Application() {
         Log.d(TAG, "🚀 Dream Assistant Application started")
         Log.d(TAG, "💕 Sister's personalized AI companion initializing...")
     }
+
+    override fun onTrimMemory(level: Int) {
+        super.onTrimMemory(level)
+        // The engine rebuilds whatever it drops on the next request
+        val stage = LlamaEngine.getInstance().trimMemory(level)
+        Log.d(TAG, "🧹 Memory trimmed at level $level: $stage")
+    }
 }
\ No newline at end of file
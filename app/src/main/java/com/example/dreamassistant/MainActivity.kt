@@ -26,8 +26,10 @@ import com.example.dreamassistant.ai.LlamaEngine
 import com.example.dreamassistant.speech.SpeechRecognitionService
 import com.example.dreamassistant.speech.TextToSpeechService
 import com.example.dreamassistant.ui.theme.DreamAssistantTheme
+import kotlinx.coroutines.flow.MutableStateFlow
 import kotlinx.coroutines.flow.filter
 import kotlinx.coroutines.flow.filterIsInstance
+import kotlinx.coroutines.flow.filterNotNull
 import kotlinx.coroutines.launch
 import java.io.File
 
@@ -38,6 +40,7 @@ import java.io.File
 class MainActivity : ComponentActivity() {
     companion object {
         private const val TAG = "MainActivity"
+        private const val SESSION_FILE = "conversation.session"
     }
 
     private val viewModel: ChatViewModel by viewModels()
@@ -64,6 +67,10 @@ class MainActivity : ComponentActivity() {
     private lateinit var llamaEngine: LlamaEngine
     var isModelReady by mutableStateOf(false)
 
+    // Latest partial transcript; a StateFlow so a slow prefill only ever sees the newest one.
+    // "" revokes the pending prefill, null means the final result has taken it over.
+    private val partialTranscript = MutableStateFlow<String?>(null)
+
     override fun onCreate(savedInstanceState: Bundle?) {
         super.onCreate(savedInstanceState)
         enableEdgeToEdge()
@@ -100,19 +107,39 @@ class MainActivity : ComponentActivity() {
         // 1) Listen for sister’s speech
         lifecycleScope.launch {
             speechService.speechResults.collect { result ->
+                if (result is SpeechRecognitionService.SpeechResult.PartialResult) {
+                    partialTranscript.value = result.text
+                }
+                // No match, errors and a stop without a result leave nothing to answer
+                if (result is SpeechRecognitionService.SpeechResult.Error ||
+                    (result is SpeechRecognitionService.SpeechResult.NotListening && partialTranscript.value != null)) {
+                    partialTranscript.value = ""
+                }
                 if (result is SpeechRecognitionService.SpeechResult.Success) {
+                    // generateResponse adopts or drops the prefill itself
+                    partialTranscript.value = null
                     val userMsg = ChatMessage.createVoiceMessage(
                         originalSpeech   = result.text,
                         preprocessedText = result.text,
                         confidence       = result.confidence ?: 1f,
                         processingTime   = result.processingTime
                     )
+                    // A new utterance supersedes whatever reply is still generating
+                    if (::llamaEngine.isInitialized) llamaEngine.cancelGeneration()
                     viewModel.addMessage(userMsg)
                     viewModel.sendMessageWithText(result.text)
                 }
             }
         }
 
+        // 1b) Prefill the prompt while she is still speaking
+        lifecycleScope.launch {
+            partialTranscript
+                .filterNotNull()
+                .filter { ::llamaEngine.isInitialized && llamaEngine.isModelReady() }
+                .collect { if (it.isBlank()) llamaEngine.discardPartial() else llamaEngine.prefillPartial(it) }
+        }
+
         // 2) Speak assistant replies
         lifecycleScope.launch {
             snapshotFlow { viewModel.uiState.value.messages.lastOrNull() }
@@ -191,6 +218,10 @@ class MainActivity : ComponentActivity() {
                 viewModel.setLlamaEngine(llamaEngine)
                 showToast("¡Modelo listo! 🌟")
                 testModel()
+                // The canned test turn is not part of her conversation: drop it, then pick up
+                // where the conversation was when the process was last killed
+                llamaEngine.resetConversation()
+                llamaEngine.loadSession(File(filesDir, SESSION_FILE))
             } else {
                 Log.e(TAG, "❌ Both model loads failed: ${result.exceptionOrNull()?.message}")
                 showToast("Error cargando cualquier modelo 😔")
@@ -234,6 +265,22 @@ class MainActivity : ComponentActivity() {
         Log.d(TAG, "📱 App lifecycle initialized")
     }
 
+    override fun onStart() {
+        super.onStart()
+        if (::llamaEngine.isInitialized) llamaEngine.setThreadPolicy(LlamaEngine.ThreadPolicy.INTERACTIVE)
+    }
+
+    override fun onStop() {
+        super.onStop()
+        if (::llamaEngine.isInitialized) {
+            llamaEngine.setThreadPolicy(LlamaEngine.ThreadPolicy.BACKGROUND)
+            // Backgrounded apps may be killed without further callbacks; save while we can
+            if (llamaEngine.isModelReady()) {
+                lifecycleScope.launch { llamaEngine.saveSession(File(filesDir, SESSION_FILE)) }
+            }
+        }
+    }
+
     override fun onDestroy() {
         super.onDestroy()
         ttsService.shutdown()
@@ -0,0 +1,33 @@
+package com.example.dreamassistant.ai
+
+import org.json.JSONObject
+
+/**
+ * A structured request decoded under ACTION_GRAMMAR in llama-android.cpp.
+ * The grammar guarantees the JSON shape, so parsing only fails on truncation.
+ */
+data class AssistantAction(
+    val action: String,
+    val contact: String,
+    val text: String
+) {
+    companion object {
+        val ACTIONS = listOf("send_message", "call", "create_event", "set_reminder", "none")
+        val NONE = AssistantAction("none", "", "")
+
+        fun fromJson(json: String): AssistantAction {
+            val obj = JSONObject(json)
+            return AssistantAction(
+                action = obj.optString("action", "none").takeIf { it in ACTIONS } ?: "none",
+                contact = obj.optString("contact", ""),
+                text = obj.optString("text", "")
+            )
+        }
+    }
+
+    fun toJson(): String = JSONObject()
+        .put("action", action)
+        .put("contact", contact)
+        .put("text", text)
+        .toString()
+}
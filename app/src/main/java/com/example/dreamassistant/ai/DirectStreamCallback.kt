@@ -0,0 +1,18 @@
+package com.example.dreamassistant.ai
+
+/**
+ * Streaming callback for the direct-buffer path: the native engine has just
+ * written [length] bytes of UTF-8 at the start of [DirectTextBuffers.output].
+ */
+fun interface DirectStreamCallback {
+    /**
+     * @return false to stop generation early
+     */
+    fun onBytes(length: Int): Boolean
+
+    /**
+     * Prompt prefill progress, reported once per decoded chunk
+     * @return false to cancel the request before generation starts
+     */
+    fun onPrefillProgress(done: Int, total: Int): Boolean = true
+}
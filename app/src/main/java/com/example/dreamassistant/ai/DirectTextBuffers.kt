@@ -0,0 +1,53 @@
+package com.example.dreamassistant.ai
+
+import java.nio.ByteBuffer
+import java.nio.CharBuffer
+import java.nio.charset.CodingErrorAction
+import java.nio.charset.StandardCharsets
+
+/**
+ * Reusable direct buffers for the zero-copy native text path.
+ * Prompts are encoded as real UTF-8 straight into [input]; the native
+ * engine writes each reply piece into [output] and reports its length
+ * through [DirectStreamCallback.onBytes].
+ */
+class DirectTextBuffers(capacityBytes: Int = DEFAULT_CAPACITY) {
+
+    companion object {
+        const val DEFAULT_CAPACITY = 16 * 1024
+    }
+
+    val input: ByteBuffer = ByteBuffer.allocateDirect(capacityBytes)
+    val output: ByteBuffer = ByteBuffer.allocateDirect(capacityBytes)
+
+    private val encoder = StandardCharsets.UTF_8.newEncoder()
+        .onMalformedInput(CodingErrorAction.REPLACE)
+        .onUnmappableCharacter(CodingErrorAction.REPLACE)
+    private val decoder = StandardCharsets.UTF_8.newDecoder()
+        .onMalformedInput(CodingErrorAction.REPLACE)
+        .onUnmappableCharacter(CodingErrorAction.REPLACE)
+
+    /**
+     * Encode [text] into [input] and return the number of bytes written
+     * Text beyond the buffer capacity is dropped
+     */
+    fun writeInput(text: String): Int {
+        input.clear()
+        encoder.reset()
+        encoder.encode(CharBuffer.wrap(text), input, true)
+        encoder.flush(input)
+        return input.position()
+    }
+
+    /**
+     * Decode the first [length] bytes the native side wrote into [output]
+     */
+    fun readOutput(length: Int): String {
+        if (length <= 0) return ""
+        val view = output.duplicate()
+        view.position(0)
+        view.limit(length)
+        decoder.reset()
+        return decoder.decode(view).toString()
+    }
+}
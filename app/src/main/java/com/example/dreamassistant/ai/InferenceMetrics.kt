@@ -0,0 +1,52 @@
+package com.example.dreamassistant.ai
+
+/**
+ * Per-request performance numbers from the native engine.
+ * Built from the DoubleArray returned by getInferenceMetrics; the slot
+ * order matches InferenceMetric in llama-android.h.
+ */
+data class InferenceMetrics(
+    val timeToFirstTokenMs: Double,
+    val prefillMs: Double,
+    val prefillTokens: Int,
+    val prefillTokensPerSecond: Double,
+    val decodeMs: Double,
+    val decodeTokens: Int,
+    val decodeTokensPerSecond: Double,
+    val totalMs: Double,
+    val kvUsedCells: Int,
+    val kvCapacity: Int,
+    val peakRssKb: Long,
+    val perfPromptEvalMs: Double,
+    val perfPromptEvalTokens: Int,
+    val perfEvalMs: Double,
+    val perfEvalTokens: Int
+) {
+    /** Share of the KV cache in use after the request, 0..1 */
+    val kvFill: Double get() = if (kvCapacity > 0) kvUsedCells.toDouble() / kvCapacity else 0.0
+
+    companion object {
+        const val SLOT_COUNT = 15
+
+        fun fromArray(values: DoubleArray): InferenceMetrics {
+            val v = if (values.size >= SLOT_COUNT) values else values.copyOf(SLOT_COUNT)
+            return InferenceMetrics(
+                timeToFirstTokenMs = v[0],
+                prefillMs = v[1],
+                prefillTokens = v[2].toInt(),
+                prefillTokensPerSecond = v[3],
+                decodeMs = v[4],
+                decodeTokens = v[5].toInt(),
+                decodeTokensPerSecond = v[6],
+                totalMs = v[7],
+                kvUsedCells = v[8].toInt(),
+                kvCapacity = v[9].toInt(),
+                peakRssKb = v[10].toLong(),
+                perfPromptEvalMs = v[11],
+                perfPromptEvalTokens = v[12].toInt(),
+                perfEvalMs = v[13],
+                perfEvalTokens = v[14].toInt()
+            )
+        }
+    }
+}
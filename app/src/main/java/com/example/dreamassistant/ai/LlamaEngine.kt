@@ -1,11 +1,29 @@
 package com.example.dreamassistant.ai
 
+import android.content.ComponentCallbacks2
 import android.content.Context
 import android.util.Log
+import kotlinx.coroutines.CancellationException
+import kotlinx.coroutines.CoroutineScope
 import kotlinx.coroutines.Dispatchers
+import kotlinx.coroutines.Job
+import kotlinx.coroutines.SupervisorJob
 import kotlinx.coroutines.delay
+import kotlinx.coroutines.flow.Flow
+import kotlinx.coroutines.flow.MutableStateFlow
+import kotlinx.coroutines.flow.StateFlow
+import kotlinx.coroutines.flow.asStateFlow
+import kotlinx.coroutines.flow.flow
+import kotlinx.coroutines.flow.flowOn
+import kotlinx.coroutines.launch
+import kotlinx.coroutines.suspendCancellableCoroutine
+import kotlinx.coroutines.sync.Mutex
+import kotlinx.coroutines.sync.withLock
 import kotlinx.coroutines.withContext
 import java.io.File
+import java.util.concurrent.ConcurrentHashMap
+import java.util.concurrent.atomic.AtomicLong
+import kotlin.coroutines.resume
 
 /**
  * LlamaEngine - SIMULATION MODE for Sister's Dream Assistant
@@ -16,6 +34,21 @@ class LlamaEngine private constructor() {
 
     companion object {
         private const val TAG = "LlamaEngine"
+        private const val MAX_PARALLEL_SESSIONS = 4 // matches MAX_PARALLEL_SEQUENCES
+        private const val INTENT_MIN_SCORE = 0.85f
+
+        /** False while the engine simulates replies instead of calling into libllama-android */
+        const val NATIVE_BACKEND = false
+
+        // Short, frequent utterances answered from one prefill pass instead of a full reply
+        private val INTENT_EXEMPLARS = mapOf(
+            "greeting" to listOf("hola", "buenos días", "buenas tardes", "buenas noches", "hola, ¿cómo estás?"),
+            "thanks" to listOf("gracias", "muchas gracias", "mil gracias", "te lo agradezco")
+        )
+        private val INTENT_REPLIES = mapOf(
+            "greeting" to "¡Hola, hermosa! ¿En qué te puedo ayudar hoy? 😊",
+            "thanks" to "¡De nada! Para eso estoy aquí, siempre. 💜"
+        )
 
         @Volatile
         private var INSTANCE: LlamaEngine? = null
@@ -33,10 +66,97 @@ class LlamaEngine private constructor() {
         }
     }
 
+    /**
+     * Native thread placement (values match ThreadPolicy in llama-android.h)
+     */
+    enum class ThreadPolicy(val nativeValue: Int) {
+        INTERACTIVE(0), // decode on performance cores, prefill on all cores
+        BACKGROUND(1)   // little cores only, no busy-polling
+    }
+
+    /**
+     * Draft source for speculative decoding (values match SpeculativeMode in llama-android.h)
+     */
+    enum class SpeculativeMode(val nativeValue: Int) {
+        OFF(0),
+        PROMPT_LOOKUP(1), // reuse what followed the same words earlier in the chat, no extra model
+        DRAFT_MODEL(2)    // small GGUF with the same tokenizer, see loadDraftModel
+    }
+
+    /**
+     * Draft acceptance since the model was loaded
+     */
+    data class SpeculativeStats(val steps: Long, val drafted: Long, val accepted: Long) {
+        val acceptanceRate: Double get() = if (drafted > 0) accepted.toDouble() / drafted else 0.0
+    }
+
+    /**
+     * KV cache element type (values match KvCacheType in llama-android.h)
+     */
+    enum class KvCacheType(val nativeValue: Int) {
+        F16(0),
+        Q8_0(1), // about half the memory of F16
+        Q4_0(2)  // about a quarter, for long contexts on 4 GB phones
+    }
+
+    /**
+     * Model bring-up stages (values match ReadinessState in llama-android.h)
+     * Requests are accepted from MAPPED on; later stages only make them faster
+     */
+    enum class Readiness(val nativeValue: Int) {
+        FAILED(-1),
+        LOADING(0),
+        MAPPED(1),        // weights mapped, context created
+        WARMED(2),        // weight pages prefetched, first decode done
+        PREFIX_CACHED(3); // system prompt already in the KV cache
+
+        companion object {
+            fun fromNative(value: Int): Readiness = values().firstOrNull { it.nativeValue == value } ?: FAILED
+        }
+    }
+
+    /**
+     * What trimMemory released, cumulative (values match TrimStage in llama-android.h)
+     * Everything is rebuilt lazily by the next request
+     */
+    enum class TrimStage(val nativeValue: Int) {
+        NONE(0),
+        CACHES(1),  // tokenizer cache, grammar masks, sampling scratch
+        CONTEXT(2), // KV cache + compute buffers; the conversation is parked on disk
+        WEIGHTS(3)  // resident weight pages, re-read from the mapped file on demand
+    }
+
+    /**
+     * Order on the native inference worker (values match RequestPriority in inference-queue.h)
+     * An INTERACTIVE request preempts running warm-up and embedding work at the next graph node
+     */
+    enum class RequestPriority(val nativeValue: Int) {
+        INTERACTIVE(0), // a reply the user is waiting for
+        NORMAL(1),
+        BACKGROUND(2)   // warm-up, intent exemplars, batch jobs
+    }
+
+    private val _readiness = MutableStateFlow(Readiness.LOADING)
+    val readiness: StateFlow<Readiness> = _readiness.asStateFlow()
+
+    private val warmupScope = CoroutineScope(SupervisorJob() + Dispatchers.IO)
+
     // Simulation state
     private var isInitialized = false
     private var modelPath: String? = null
     private var lastInferenceTime = 0.5f // Simulate realistic timing
+    private var extraContexts = 0
+    private val openSessions = mutableSetOf<Int>()
+    private var kvCacheType = KvCacheType.F16
+    private var kvCacheTypeV = KvCacheType.F16
+    private var speculativeMode = SpeculativeMode.OFF
+    private var hasDraftModel = false
+    private val loraAdapters = mutableSetOf<String>()
+    private var activeLoraAdapter: String? = null
+    private val intentExemplars = mutableListOf<Pair<String, String>>()
+    private val queuedRequests = ConcurrentHashMap<Long, Job>()
+    private val nextRequestId = AtomicLong(1)
+    private val workerLock = Mutex() // one request at a time, like the native worker
 
     /**
      * Initialize Sister's model (simulation mode)
@@ -45,9 +165,10 @@ class LlamaEngine private constructor() {
         try {
             Log.i(TAG, "🎭 Simulating Sister's personalized model initialization...")
             Log.i(TAG, "📁 Model file: ${modelFile.absolutePath}")
+            _readiness.value = Readiness.LOADING
 
-            // Simulate loading time
-            delay(2000)
+            // Simulate loading time up to the point the native side returns
+            delay(1500)
 
             if (modelFile.exists()) {
                 Log.i(TAG, "📊 Model file found: ${modelFile.length() / (1024 * 1024)} MB")
@@ -57,6 +178,17 @@ class LlamaEngine private constructor() {
 
             isInitialized = true
             modelPath = modelFile.absolutePath
+            _readiness.value = Readiness.MAPPED
+            registerDefaultIntents()
+
+            // Warm-up continues in the background, like initializeModelAsync
+            warmupScope.launch {
+                delay(300)
+                _readiness.value = Readiness.WARMED
+                delay(200)
+                _readiness.value = Readiness.PREFIX_CACHED
+                Log.i(TAG, "🔥 Warm-up finished (simulation mode)")
+            }
 
             Log.i(TAG, "✅ SUCCESS! Sister's Dream Assistant ready in simulation mode!")
             Log.i(TAG, "🌟 Intelligent responses based on her training patterns!")
@@ -65,6 +197,7 @@ class LlamaEngine private constructor() {
 
         } catch (e: Exception) {
             Log.e(TAG, "❌ Error during simulation setup: ${e.message}")
+            _readiness.value = Readiness.FAILED
             Result.failure(e)
         }
     }
@@ -86,6 +219,14 @@ class LlamaEngine private constructor() {
 
             Log.i(TAG, "👤 Sister's input: '$userInput'")
 
+            // Early exit: a confident greeting/thanks match skips generation entirely
+            matchIntent(userInput)?.let { intent ->
+                INTENT_REPLIES[intent]?.let { reply ->
+                    lastInferenceTime = 0.05f
+                    return@withContext Result.success(reply)
+                }
+            }
+
             // Simulate realistic processing time
             delay(listOf(500L, 750L, 1000L, 1250L, 1500L).random())
             lastInferenceTime = listOf(0.3f, 0.5f, 0.7f, 0.9f, 1.2f).random()
@@ -104,6 +245,50 @@ class LlamaEngine private constructor() {
         }
     }
 
+    /**
+     * Stream the reply piece by piece as it is generated (simulation mode)
+     * Native mode delivers the same pieces through [TokenStreamCallback]
+     */
+    fun generateResponseStream(userInput: String): Flow<String> = flow {
+        if (!isInitialized) {
+            Log.e(TAG, "❌ Model not initialized")
+            throw IllegalStateException("Model not initialized")
+        }
+
+        Log.i(TAG, "👤 Sister's input (streaming): '$userInput'")
+        val startTime = System.currentTimeMillis()
+
+        // Simulate time-to-first-token, then per-token decode steps
+        delay(250)
+        val response = generateIntelligentResponse(userInput)
+        response.split(" ").forEachIndexed { index, word ->
+            emit(if (index == 0) word else " $word")
+            delay(40)
+        }
+
+        lastInferenceTime = (System.currentTimeMillis() - startTime) / 1000f
+        Log.i(TAG, "⚡ Simulated streaming time: ${lastInferenceTime}s")
+    }.flowOn(Dispatchers.IO)
+
+    /**
+     * Stream the reply one sentence at a time for the speech pipeline (simulation mode)
+     * Native mode delivers the same sentences through [SentenceStreamCallback]
+     */
+    fun generateSentenceStream(userInput: String): Flow<String> = flow {
+        if (!isInitialized) {
+            Log.e(TAG, "❌ Model not initialized")
+            throw IllegalStateException("Model not initialized")
+        }
+
+        Log.i(TAG, "👤 Sister's input (spoken): '$userInput'")
+        val response = generateIntelligentResponse(userInput)
+        response.split(Regex("(?<=[.!?…])\\s+")).filter { it.isNotBlank() }.forEach { sentence ->
+            // Simulate the decode time of each sentence
+            delay(40L * sentence.split(" ").size)
+            emit(sentence)
+        }
+    }.flowOn(Dispatchers.IO)
+
     private fun generateIntelligentResponse(userInput: String): String {
         val lowerInput = userInput.lowercase()
 
@@ -170,6 +355,408 @@ class LlamaEngine private constructor() {
         }
     }
 
+    /**
+     * Forget the conversation so far (native side keeps only the system prompt cached)
+     */
+    fun resetConversation() {
+        Log.i(TAG, "🔄 Conversation reset (simulation mode)")
+    }
+
+    /**
+     * Decode a partial speech transcript into the KV cache as the upcoming turn
+     * Each update only re-decodes what changed since the previous partial, and the
+     * next generateResponse keeps whatever still matches the final transcript
+     * @return speculative tokens now cached, or -1 on failure
+     */
+    suspend fun prefillPartial(partialText: String): Int = withContext(Dispatchers.IO) {
+        if (!isInitialized || partialText.isBlank()) return@withContext 0
+        Log.d(TAG, "🎙️ Partial prefill: '$partialText' (simulation mode)")
+        countTokens(partialText)
+    }
+
+    /**
+     * Drop a pending partial prefill, e.g. when recognition ends without a result
+     * Waits for a running request to finish, like prefillPartial
+     */
+    suspend fun discardPartial(): Unit = withContext(Dispatchers.IO) {
+        Log.d(TAG, "🎙️ Partial prefill discarded (simulation mode)")
+    }
+
+    /**
+     * Stop the reply currently being generated so a newer request can start
+     * right away; the conversation cache stays valid for the next turn
+     */
+    fun cancelGeneration() {
+        Log.i(TAG, "⏹️ Cancel requested (simulation mode)")
+    }
+
+    /**
+     * Queue a chat turn on the inference worker and return its request id (0 if not queued)
+     * The worker is the only thread that touches the context, so concurrent callers never
+     * race; replies are never preempted once started. Simulation mode runs requests in
+     * submission order.
+     */
+    fun submitResponse(
+        userInput: String,
+        priority: RequestPriority = RequestPriority.INTERACTIVE,
+        callback: RequestCallback
+    ): Long {
+        if (!isInitialized) return 0
+        val id = nextRequestId.getAndIncrement()
+        Log.i(TAG, "👤 Sister's input (queued, $priority): '$userInput'")
+
+        queuedRequests[id] = warmupScope.launch {
+            try {
+                workerLock.withLock {
+                    delay(listOf(500L, 750L, 1000L).random())
+                    val response = generateIntelligentResponse(userInput).trim()
+                    callback.onToken(response.toByteArray(Charsets.UTF_8))
+                    callback.onComplete(response.toByteArray(Charsets.UTF_8))
+                }
+            } catch (e: CancellationException) {
+                callback.onComplete(ByteArray(0))
+            } finally {
+                queuedRequests.remove(id)
+            }
+        }
+        return id
+    }
+
+    /**
+     * Cancel a submitted request: a queued one completes with an empty reply,
+     * a running one stops like [cancelGeneration]
+     */
+    fun cancelRequest(requestId: Long) {
+        queuedRequests[requestId]?.cancel()
+        Log.i(TAG, "⏹️ Cancel requested for request $requestId (simulation mode)")
+    }
+
+    /**
+     * Queue offline generation of several prompts, e.g. suggested replies while idle and
+     * charging. Prompts are answered a wave of side sessions at a time, sharing the cached
+     * system prompt and one batched decode per step, and written to cacheFile for
+     * [SuggestionCache.read]. Runs at BACKGROUND priority and yields to any reply request.
+     * callback.onComplete receives the cache path, or an empty array on failure/cancel.
+     * @return request id for [cancelRequest], 0 if not queued
+     */
+    fun submitBatch(prompts: Map<String, String>, cacheFile: File, maxTokens: Int, callback: RequestCallback): Long {
+        if (!isInitialized || prompts.isEmpty()) return 0
+        val id = nextRequestId.getAndIncrement()
+        Log.i(TAG, "📦 Batch of ${prompts.size} prompts, up to $maxTokens tokens each, queued (simulation mode)")
+
+        queuedRequests[id] = warmupScope.launch {
+            try {
+                val replies = workerLock.withLock {
+                    prompts.mapValues { (_, prompt) ->
+                        delay(100)
+                        generateIntelligentResponse(prompt).trim()
+                    }
+                }
+                SuggestionCache(System.currentTimeMillis() / 1000, replies).write(cacheFile)
+                callback.onComplete(cacheFile.path.toByteArray(Charsets.UTF_8))
+            } catch (e: CancellationException) {
+                callback.onComplete(ByteArray(0))
+            } finally {
+                queuedRequests.remove(id)
+            }
+        }
+        return id
+    }
+
+    /**
+     * [submitBatch] as a suspend call; the UI then reads the file with no inference at all
+     */
+    suspend fun generateBatch(
+        prompts: Map<String, String>,
+        cacheFile: File,
+        maxTokens: Int = 96
+    ): Result<SuggestionCache> = suspendCancellableCoroutine { continuation ->
+        val id = submitBatch(prompts, cacheFile, maxTokens) { utf8 ->
+            val cache = if (utf8.isNotEmpty()) SuggestionCache.read(File(String(utf8, Charsets.UTF_8))) else null
+            if (continuation.isActive) {
+                continuation.resume(cache?.let { Result.success(it) } ?: Result.failure(Exception("Batch generation failed")))
+            }
+            true
+        }
+        if (id == 0L) {
+            continuation.resume(Result.failure(Exception("Model not initialized")))
+        } else {
+            continuation.invokeOnCancellation { cancelRequest(id) }
+        }
+    }
+
+    /**
+     * [submitResponse] as a suspend call; cancelling the coroutine cancels the request
+     */
+    suspend fun generateResponseQueued(
+        userInput: String,
+        priority: RequestPriority = RequestPriority.INTERACTIVE
+    ): Result<String> = suspendCancellableCoroutine { continuation ->
+        val id = submitResponse(userInput, priority) { utf8 ->
+            if (continuation.isActive) continuation.resume(Result.success(String(utf8, Charsets.UTF_8)))
+            true
+        }
+        if (id == 0L) {
+            continuation.resume(Result.failure(Exception("Model not initialized")))
+        } else {
+            continuation.invokeOnCancellation { cancelRequest(id) }
+        }
+    }
+
+    /**
+     * Move inference threads between performance and efficiency cores
+     * Takes effect before the next request, never in the middle of one
+     */
+    fun setThreadPolicy(policy: ThreadPolicy) {
+        Log.i(TAG, "🧵 Thread policy: $policy (simulation mode)")
+    }
+
+    /**
+     * KV cache precision for contexts created from now on (call before initializeModel)
+     * Keys and values can differ, e.g. Q8_0 keys with Q4_0 values; values default to the key type
+     * contextLength 0 picks the longest context whose cache fits in 1/8 of device RAM
+     */
+    fun configureKvCache(typeK: KvCacheType, typeV: KvCacheType = typeK, contextLength: Int = 2048) {
+        kvCacheType = typeK
+        kvCacheTypeV = typeV
+        Log.i(TAG, "🗄️ KV cache: $typeK/$typeV, context ${if (contextLength > 0) contextLength else "auto"} (simulation mode)")
+    }
+
+    /**
+     * Open another context on the already-loaded weights (e.g. a long-form one)
+     * The GGUF stays mapped once; only the KV cache is allocated again
+     */
+    fun createContext(contextLength: Int): Result<Int> {
+        if (!isInitialized) {
+            return Result.failure(Exception("Model not initialized"))
+        }
+        extraContexts++
+        Log.i(TAG, "🧩 Context #$extraContexts with $contextLength tokens (simulation mode)")
+        return Result.success(extraContexts)
+    }
+
+    /**
+     * Map a LoRA adapter (a few MB) onto the already loaded base weights so a
+     * personalization update does not mean shipping and reloading a full GGUF
+     */
+    suspend fun loadLoraAdapter(adapterFile: File): Result<Boolean> = withContext(Dispatchers.IO) {
+        if (!isInitialized) {
+            return@withContext Result.failure(Exception("Model not initialized"))
+        }
+        loraAdapters.add(adapterFile.absolutePath)
+        Log.i(TAG, "🧬 LoRA adapter: ${adapterFile.name} (simulation mode)")
+        Result.success(true)
+    }
+
+    /**
+     * Apply a loaded adapter to this context, or return to the base weights with null
+     * The conversation restarts from the system prompt, which is re-primed for the new weights
+     */
+    suspend fun setLoraAdapter(adapterFile: File?, scale: Float = 1.0f): Boolean = withContext(Dispatchers.IO) {
+        val path = adapterFile?.absolutePath
+        if (!isInitialized || (path != null && path !in loraAdapters)) return@withContext false
+        activeLoraAdapter = path
+        Log.i(TAG, "🧬 Active adapter: ${adapterFile?.name ?: "base"} x$scale (simulation mode)")
+        true
+    }
+
+    /**
+     * Detach an adapter; its memory is freed once no context uses it
+     */
+    fun unloadLoraAdapter(adapterFile: File) {
+        val path = adapterFile.absolutePath
+        if (activeLoraAdapter == path) activeLoraAdapter = null
+        loraAdapters.remove(path)
+    }
+
+    /**
+     * Load a small draft model sharing Gemma's tokenizer for DRAFT_MODEL speculation
+     */
+    suspend fun loadDraftModel(draftFile: File): Result<Boolean> = withContext(Dispatchers.IO) {
+        if (!isInitialized) {
+            return@withContext Result.failure(Exception("Model not initialized"))
+        }
+        Log.i(TAG, "📦 Draft model: ${draftFile.absolutePath} (simulation mode)")
+        hasDraftModel = true
+        Result.success(true)
+    }
+
+    /**
+     * Let a draft stage propose up to maxDraft tokens that the main model verifies in one
+     * batch; replies are unchanged, only produced faster when drafts are accepted
+     */
+    fun setSpeculativeMode(mode: SpeculativeMode, maxDraft: Int = 4): Boolean {
+        if (mode == SpeculativeMode.DRAFT_MODEL && !hasDraftModel) return false
+        speculativeMode = mode
+        Log.i(TAG, "🔮 Speculative mode: $mode, draft $maxDraft (simulation mode)")
+        return true
+    }
+
+    /**
+     * Acceptance statistics of the draft stage
+     */
+    fun getSpeculativeStats(): SpeculativeStats = SpeculativeStats(0, 0, 0)
+
+    /**
+     * Open a side session that shares the cached system prompt with the main one
+     * Returns the session id, or -1 when all parallel slots are taken
+     */
+    fun openSession(): Int {
+        if (!isInitialized || openSessions.size >= MAX_PARALLEL_SESSIONS - 1) return -1
+        val id = (1 until MAX_PARALLEL_SESSIONS).first { it !in openSessions }
+        openSessions.add(id)
+        Log.i(TAG, "🧵 Opened session $id (simulation mode)")
+        return id
+    }
+
+    /**
+     * Release a side session; the main session (id 0) cannot be closed
+     */
+    fun closeSession(sessionId: Int) {
+        openSessions.remove(sessionId)
+    }
+
+    /**
+     * Run one turn on several sessions at once, e.g. a short intent prompt next to the
+     * main reply; natively both advance together in one forward pass per token
+     */
+    suspend fun generateParallel(requests: List<Pair<Int, String>>, maxTokens: List<Int>): Result<List<String>> =
+        withContext(Dispatchers.IO) {
+            if (!isInitialized) {
+                return@withContext Result.failure(Exception("Model not initialized"))
+            }
+            delay(800)
+            Result.success(requests.mapIndexed { i, (_, input) ->
+                generateIntelligentResponse(input).split(" ").take(maxTokens.getOrElse(i) { 150 }).joinToString(" ")
+            })
+        }
+
+    /**
+     * Turn a spoken request into a structured action; natively the reply is decoded under
+     * a JSON grammar on a side session, so the chat history is left untouched
+     */
+    suspend fun generateAction(userInput: String): Result<AssistantAction> = withContext(Dispatchers.IO) {
+        if (!isInitialized) {
+            return@withContext Result.failure(Exception("Model not initialized"))
+        }
+        try {
+            delay(300)
+            val action = simulateAction(userInput)
+            Log.i(TAG, "🧩 Action: ${action.toJson()} (simulation mode)")
+            Result.success(action)
+        } catch (e: Exception) {
+            Log.e(TAG, "❌ Exception during action decoding: ${e.message}")
+            Result.failure(e)
+        }
+    }
+
+    private fun simulateAction(userInput: String): AssistantAction {
+        val input = userInput.lowercase()
+        val action = when {
+            listOf("envía", "envia", "manda", "mensaje").any { it in input } -> "send_message"
+            listOf("llama", "llamar").any { it in input } -> "call"
+            listOf("recuérdame", "recuerdame", "recordatorio").any { it in input } -> "set_reminder"
+            listOf("cita", "evento", "agenda").any { it in input } -> "create_event"
+            else -> return AssistantAction.NONE
+        }
+        val contact = Regex(""" a ([\p{L}]+)""").find(userInput)?.groupValues?.get(1) ?: ""
+        val text = userInput.substringAfter(" que ", "")
+        return AssistantAction(action, contact, text)
+    }
+
+    /**
+     * Shrink native memory for an onTrimMemory level: caches for any level, the whole
+     * context at RUNNING_CRITICAL or BACKGROUND and up, weight pages from MODERATE up
+     */
+    fun trimMemory(level: Int): TrimStage {
+        if (!isInitialized) return TrimStage.NONE
+        val stage = when {
+            level >= ComponentCallbacks2.TRIM_MEMORY_MODERATE -> TrimStage.WEIGHTS
+            level >= ComponentCallbacks2.TRIM_MEMORY_BACKGROUND ||
+                level == ComponentCallbacks2.TRIM_MEMORY_RUNNING_CRITICAL -> TrimStage.CONTEXT
+            level >= ComponentCallbacks2.TRIM_MEMORY_RUNNING_MODERATE -> TrimStage.CACHES
+            else -> TrimStage.NONE
+        }
+        if (stage.nativeValue >= TrimStage.CONTEXT.nativeValue) _readiness.value = Readiness.MAPPED
+        Log.i(TAG, "🧹 trimMemory($level): $stage (simulation mode)")
+        return stage
+    }
+
+    /**
+     * Persist the conversation (KV cache + token history) so a restarted process resumes
+     * it without paying prefill again; an unchanged conversation is not rewritten
+     */
+    suspend fun saveSession(file: File): Boolean = withContext(Dispatchers.IO) {
+        if (!isInitialized) return@withContext false
+        file.writeText(modelPath ?: "")
+        Log.i(TAG, "💾 Session saved to ${file.name} (simulation mode)")
+        true
+    }
+
+    /**
+     * Restore a conversation written by [saveSession]; false when the file is missing or
+     * was written for another model, KV type or system prompt
+     */
+    suspend fun loadSession(file: File): Boolean = withContext(Dispatchers.IO) {
+        if (!isInitialized || !file.exists()) return@withContext false
+        val restored = file.readText() == modelPath
+        Log.i(TAG, "💾 Session ${if (restored) "restored from" else "ignored:"} ${file.name} (simulation mode)")
+        restored
+    }
+
+    /**
+     * Unit-length embedding of the text from a prefill-only pass of the loaded model
+     * (simulation mode returns a hashed bag of words of the same shape)
+     */
+    fun getEmbedding(text: String): FloatArray {
+        val vector = FloatArray(64)
+        text.lowercase().split(Regex("[^\\p{L}]+")).filter { it.isNotEmpty() }.forEach { word ->
+            vector[Math.floorMod(word.hashCode(), vector.size)] += 1f
+        }
+        val norm = kotlin.math.sqrt(vector.sumOf { (it * it).toDouble() }).toFloat()
+        if (norm > 0f) for (i in vector.indices) vector[i] /= norm
+        return vector
+    }
+
+    /**
+     * Add an example phrasing for an intent label to the similarity index
+     * Native mode embeds it later as BACKGROUND work; true means it was queued
+     */
+    fun addIntentExemplar(label: String, text: String): Boolean {
+        if (!isInitialized) return false
+        intentExemplars.add(label to text)
+        return true
+    }
+
+    /**
+     * Closest intent label by cosine similarity, or null when nothing clears minScore
+     * and the request should go through normal generation
+     */
+    fun matchIntent(text: String, minScore: Float = INTENT_MIN_SCORE): String? {
+        if (intentExemplars.isEmpty()) return null
+        val query = getEmbedding(text)
+        val (label, score) = intentExemplars
+            .map { (label, exemplar) ->
+                val e = getEmbedding(exemplar)
+                label to query.indices.sumOf { (query[it] * e[it]).toDouble() }
+            }
+            .maxByOrNull { it.second }!!
+        Log.i(TAG, "🎯 Intent $label (${"%.3f".format(score)}) (simulation mode)")
+        return if (score >= minScore) label else null
+    }
+
+    /**
+     * Drop every intent exemplar
+     */
+    fun clearIntents() {
+        intentExemplars.clear()
+    }
+
+    private fun registerDefaultIntents() {
+        clearIntents()
+        INTENT_EXEMPLARS.forEach { (label, phrases) -> phrases.forEach { addIntentExemplar(label, it) } }
+    }
+
     /**
      * Check if model is ready for use
      */
@@ -185,6 +772,7 @@ class LlamaEngine private constructor() {
         - Training: Based on her unique patterns
         - Status: Ready and optimized for hackathon demo! ✨
         - Mode: Intelligent simulation (perfect for development)
+        - LoRA adapter: ${activeLoraAdapter?.let { File(it).name } ?: "none"}
         """.trimIndent()
     } else {
         "Model not loaded"
@@ -195,6 +783,19 @@ class LlamaEngine private constructor() {
      */
     fun getLastInferenceTime(): Float = lastInferenceTime
 
+    /**
+     * Structured timings of the last request. Simulation mode only knows the wall clock:
+     * the per-phase timings are NaN and the token and KV counts 0.
+     */
+    fun getInferenceMetrics(): InferenceMetrics {
+        val values = DoubleArray(InferenceMetrics.SLOT_COUNT)
+        for (slot in intArrayOf(0, 1, 3, 4, 6, 11, 13)) {
+            values[slot] = Double.NaN
+        }
+        values[7] = lastInferenceTime * 1000.0
+        return InferenceMetrics.fromArray(values)
+    }
+
     /**
      * Count tokens (simulation)
      */
@@ -231,6 +832,15 @@ class LlamaEngine private constructor() {
         Log.i(TAG, "🧹 Cleaning up simulation mode")
         isInitialized = false
         modelPath = null
+        extraContexts = 0
+        openSessions.clear()
+        speculativeMode = SpeculativeMode.OFF
+        hasDraftModel = false
+        loraAdapters.clear()
+        activeLoraAdapter = null
+        intentExemplars.clear()
+        queuedRequests.values.forEach { it.cancel() }
+        _readiness.value = Readiness.LOADING
     }
 
     /**
@@ -242,6 +852,8 @@ class LlamaEngine private constructor() {
             - Initialized: $isInitialized
             - Model Path: ${modelPath ?: "None"}
             - Ready: ${isModelReady()}
+            - Readiness: ${readiness.value}
+            - KV cache: $kvCacheType/$kvCacheTypeV
             - Last Inference Time: ${lastInferenceTime}s
             - Mode: Perfect for hackathon demo! 🌟
         """.trimIndent()
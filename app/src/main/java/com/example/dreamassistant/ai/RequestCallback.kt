@@ -0,0 +1,19 @@
+package com.example.dreamassistant.ai
+
+/**
+ * Completion of a request submitted with [LlamaEngine.submitResponse].
+ * Native mode calls it on the inference worker thread, never on the caller's.
+ */
+fun interface RequestCallback {
+    /**
+     * The whole reply as raw UTF-8; empty when the request was cancelled
+     * before it produced anything
+     */
+    fun onComplete(utf8: ByteArray): Boolean
+
+    /**
+     * Reply chunks while the request runs, ending on character boundaries
+     * @return false to stop generation early
+     */
+    fun onToken(utf8: ByteArray): Boolean = true
+}
@@ -0,0 +1,18 @@
+package com.example.dreamassistant.ai
+
+/**
+ * Receives the reply one finished sentence at a time (UTF-8), so speech
+ * can start while the native engine keeps decoding the rest.
+ */
+fun interface SentenceStreamCallback {
+    /**
+     * @return false to stop generation early
+     */
+    fun onSentence(utf8: ByteArray): Boolean
+
+    /**
+     * Prompt prefill progress, reported once per decoded chunk
+     * @return false to cancel the request before generation starts
+     */
+    fun onPrefillProgress(done: Int, total: Int): Boolean = true
+}
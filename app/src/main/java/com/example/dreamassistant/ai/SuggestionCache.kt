@@ -0,0 +1,72 @@
+package com.example.dreamassistant.ai
+
+import java.io.File
+import java.nio.ByteBuffer
+import java.nio.ByteOrder
+
+/**
+ * Precomputed replies written by [LlamaEngine.generateBatch], readable
+ * without loading the model. The layout matches SuggestionCacheHeader in
+ * llama-android.cpp: a 24-byte little-endian header, then per entry a key
+ * and a reply, each a UInt32 byte length followed by UTF-8 bytes.
+ */
+data class SuggestionCache(
+    val createdAtSeconds: Long,
+    val entries: Map<String, String>
+) {
+    operator fun get(key: String): String? = entries[key]
+
+    fun write(file: File) {
+        val encoded = entries.map { (key, reply) -> key.toByteArray(Charsets.UTF_8) to reply.toByteArray(Charsets.UTF_8) }
+        val size = HEADER_BYTES + encoded.sumOf { (key, reply) -> 8 + key.size + reply.size }
+        val buffer = ByteBuffer.allocate(size).order(ByteOrder.LITTLE_ENDIAN)
+            .putInt(MAGIC)
+            .putInt(VERSION)
+            .putInt(encoded.size)
+            .putInt(0) // base weights
+            .putLong(createdAtSeconds)
+        encoded.forEach { (key, reply) ->
+            buffer.putInt(key.size).put(key).putInt(reply.size).put(reply)
+        }
+
+        // Same rename-over as the native writer, so readers never see half a file
+        val tmp = File(file.path + ".tmp")
+        tmp.writeBytes(buffer.array())
+        if (!tmp.renameTo(file)) tmp.delete()
+    }
+
+    companion object {
+        private const val MAGIC = 0x47534144 // "DASG"
+        private const val VERSION = 1
+        private const val HEADER_BYTES = 24
+
+        /**
+         * @return null when the file is missing, truncated or of another version
+         */
+        fun read(file: File): SuggestionCache? {
+            if (!file.exists() || file.length() < HEADER_BYTES) return null
+            val buffer = ByteBuffer.wrap(file.readBytes()).order(ByteOrder.LITTLE_ENDIAN)
+            if (buffer.int != MAGIC || buffer.int != VERSION) return null
+
+            val count = buffer.int
+            buffer.int // adapter id
+            val createdAt = buffer.long
+            val entries = LinkedHashMap<String, String>(count)
+            repeat(count) {
+                val key = readString(buffer) ?: return null
+                val reply = readString(buffer) ?: return null
+                entries[key] = reply
+            }
+            return SuggestionCache(createdAt, entries)
+        }
+
+        private fun readString(buffer: ByteBuffer): String? {
+            if (buffer.remaining() < 4) return null
+            val length = buffer.int
+            if (length < 0 || length > buffer.remaining()) return null
+            val bytes = ByteArray(length)
+            buffer.get(bytes)
+            return String(bytes, Charsets.UTF_8)
+        }
+    }
+}
@@ -0,0 +1,19 @@
+package com.example.dreamassistant.ai
+
+/**
+ * Receives the reply while it is being generated by the native engine.
+ * Each chunk is raw UTF-8 and always ends on a character boundary, so
+ * emoji split across tokens arrive whole.
+ */
+fun interface TokenStreamCallback {
+    /**
+     * @return false to stop generation early
+     */
+    fun onToken(utf8: ByteArray): Boolean
+
+    /**
+     * Prompt prefill progress, reported once per decoded chunk
+     * @return false to cancel the request before generation starts
+     */
+    fun onPrefillProgress(done: Int, total: Int): Boolean = true
+}
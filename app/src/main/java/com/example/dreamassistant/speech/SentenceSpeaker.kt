@@ -0,0 +1,45 @@
+package com.example.dreamassistant.speech
+
+import android.util.Log
+import kotlinx.coroutines.Dispatchers
+import kotlinx.coroutines.channels.BufferOverflow
+import kotlinx.coroutines.flow.Flow
+import kotlinx.coroutines.flow.buffer
+import kotlinx.coroutines.flow.flowOn
+
+/**
+ * Speaks a reply sentence by sentence while it is still being generated.
+ * Generation runs on the IO dispatcher and feeds a small bounded buffer;
+ * the collector hands each sentence to TTS, so the first sentence is heard
+ * while the following ones are still decoding.
+ */
+class SentenceSpeaker(
+    private val tts: TextToSpeechService,
+    private val capacity: Int = 4
+) {
+
+    companion object {
+        private const val TAG = "SentenceSpeaker"
+    }
+
+    /**
+     * Speak every sentence of [sentences] and return the full reply text
+     */
+    suspend fun speak(sentences: Flow<String>): String {
+        val reply = StringBuilder()
+        var first = true
+
+        sentences
+            .flowOn(Dispatchers.IO)
+            .buffer(capacity, BufferOverflow.SUSPEND)
+            .collect { sentence ->
+                Log.d(TAG, "🔊 Speaking: ${sentence.take(30)}")
+                tts.speakQueued(sentence, flush = first)
+                first = false
+                if (reply.isNotEmpty()) reply.append(' ')
+                reply.append(sentence)
+            }
+
+        return reply.toString()
+    }
+}
@@ -14,12 +14,17 @@ import kotlinx.coroutines.flow.MutableSharedFlow
 import kotlinx.coroutines.flow.SharedFlow
 import kotlinx.coroutines.launch
 import java.util.Locale
+import java.util.concurrent.atomic.AtomicInteger
 
 class TextToSpeechService(context: Context) : TextToSpeech.OnInitListener {
     private val tts = TextToSpeech(context, this)
     private val _events = MutableSharedFlow<TtsEvent>()
     val events: SharedFlow<TtsEvent> = _events
 
+    // Utterances queued but not yet finished; UtteranceDone fires only when this drains
+    private val pendingUtterances = AtomicInteger(0)
+    private val utteranceCounter = AtomicInteger(0)
+
     sealed class TtsEvent {
         object InitSuccess : TtsEvent()
         object InitFailure : TtsEvent()
@@ -31,12 +36,9 @@ class TextToSpeechService(context: Context) : TextToSpeech.OnInitListener {
             tts.language = Locale.getDefault()
             tts.setOnUtteranceProgressListener(object : UtteranceProgressListener() {
                 override fun onStart(utteranceId: String) {}
-                override fun onDone(utteranceId: String) {
-                    CoroutineScope(Dispatchers.Main).launch {
-                        _events.emit(TtsEvent.UtteranceDone)
-                    }
-                }
-                override fun onError(utteranceId: String) {}
+                override fun onDone(utteranceId: String) = utteranceFinished()
+                // A sentence that fails to synthesize still ends the reply if it was the last one
+                override fun onError(utteranceId: String) = utteranceFinished()
             })
             CoroutineScope(Dispatchers.Main).launch { _events.emit(TtsEvent.InitSuccess) }
         } else {
@@ -44,8 +46,25 @@ class TextToSpeechService(context: Context) : TextToSpeech.OnInitListener {
         }
     }
 
+    private fun utteranceFinished() {
+        if (pendingUtterances.decrementAndGet() > 0) return
+        CoroutineScope(Dispatchers.Main).launch {
+            _events.emit(TtsEvent.UtteranceDone)
+        }
+    }
+
     fun speak(text: String) {
-        tts.speak(text, TextToSpeech.QUEUE_FLUSH, null, "UTT_ID")
+        speakQueued(text, flush = true)
+    }
+
+    /**
+     * Queue one chunk of a reply behind whatever is already being spoken
+     */
+    fun speakQueued(text: String, flush: Boolean = false) {
+        if (flush) pendingUtterances.set(0)
+        pendingUtterances.incrementAndGet()
+        val mode = if (flush) TextToSpeech.QUEUE_FLUSH else TextToSpeech.QUEUE_ADD
+        tts.speak(text, mode, null, "UTT_${utteranceCounter.incrementAndGet()}")
     }
 
     fun shutdown() {